@@ -23,28 +23,259 @@
 #include <linux/random.h>
 #include <linux/poll.h>
 #include <linux/wait.h>
+#include <linux/kfifo.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/sched/isolation.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+#include "nxp_simtemp.h"
+/* Instantiate the tracepoints declared in nxp_simtemp_trace.h, only one source file may do it */
+#define CREATE_TRACE_POINTS
+#include "nxp_simtemp_trace.h"
 
 
 
 /****************************/
 /**** Macro definitions *****/
 /****************************/
-#define UPPER_THRESHOLD_TEMP_SIMULATION_MILI_C 50000U
-#define LOWER_THRESHOLD_TEMP_SIMULATION_MILI_C 20000U
-#define NORMAL_TEMPERATURE_VALUE               32000U
-#define TEMP_SIMULATION_INCREMENTS               500U
-#define MODE_NORMAL                                0U
-#define MODE_NOISY                                 1U
-#define MODE_RAMP                                  2U
-#define MAX_DEV                                    1U
+#define UPPER_THRESHOLD_TEMP_SIMULATION_MILI_C 50000  /* Default ramp limits */
+#define LOWER_THRESHOLD_TEMP_SIMULATION_MILI_C 20000
+#define NORMAL_TEMPERATURE_VALUE               32000  /* Default waveform offset */
+#define TEMP_SIMULATION_INCREMENTS               500U /* Default ramp step */
+#define DEFAULT_NOISE_AMPLITUDE_MILI_C          5000U /* Default amplitude, standard deviation of the noisy mode */
+#define DEFAULT_WAVEFORM_PERIOD_NS      10000000000ULL
+#define DEFAULT_WAVEFORM_SEED       0x73696D74656D70ULL /* "simtemp", device N uses this seed + N */
+#define SIMTEMP_SINE_TABLE_SIZE                  256U /* Entries of simtemp_sine_table, must be a power of 2 */
+#define MODE_NORMAL                SIMTEMP_MODE_NORMAL
+#define MODE_NOISY                  SIMTEMP_MODE_NOISY
+#define MODE_RAMP                    SIMTEMP_MODE_RAMP
+#define MODE_SINE                    SIMTEMP_MODE_SINE
+#define MODE_SQUARE                SIMTEMP_MODE_SQUARE
+#define MODE_REPLAY                SIMTEMP_MODE_REPLAY
+#define MAX_DEV                                 1024U /* Upper limit of the nr_devices module parameter */
+#define DEFAULT_SAMPLING_PERIOD_NS       200000000ULL
+#define DEFAULT_BATCH_PERIOD_NS              1000000UL /* Periods shorter than 1 ms are sampled in batches */
+#define BATCH_PERIOD_MAX_NS                100000000UL /* Upper limit of the batch_period_ns module parameter */
+#define SIMTEMP_BATCH_MAX_SAMPLES               1024U /* Largest number of samples taken in one timer expiration */
+#define DEFAULT_TEMPERATURE_THRESHOLD_MILI_C   40000
+#define DEFAULT_HYSTERESIS_MILI_C               1000U
+#define SIMTEMP_FIFO_SIZE                       1024U /* Number of samples buffered per reader, must be a power of 2 */
+#define SIMTEMP_EVENT_FIFO_SIZE                   64U /* Number of threshold events buffered per reader, must be a power of 2 */
+#define SIMTEMP_SUMMARY_FIFO_SIZE                 64U /* Number of window summaries buffered per reader, must be a power of 2 */
+#define SIMTEMP_DELTA_CHUNK_BYTES                256U /* Encoded bytes staged on the stack per copy_to_user() */
+#define DEFAULT_WINDOW_NS                1000000000ULL /* One summary per second */
+#define DEFAULT_CHAIN_EMA_ALPHA_Q16             6554U /* ~0.1 in Q16 */
+#define DEFAULT_CHAIN_AVERAGE_WINDOW               8U
+#define DEFAULT_CHAIN_MEDIAN_WINDOW                5U
+#define SIMTEMP_RING_CAPACITY                   1024U /* Number of slots of the mmap() ring, must be a power of 2 */
+#define SIMTEMP_RING_DATA_OFFSET            PAGE_SIZE /* The header uses the first page of the ring */
+#define SIMTEMP_RING_BYTES (SIMTEMP_RING_DATA_OFFSET + (SIMTEMP_RING_CAPACITY * sizeof(struct simtemp_sample)))
+#define TIMER_SCHED_PER_DEVICE                     0U /* Every device arms its own hrtimer */
+#define TIMER_SCHED_GROUPED                        1U /* Devices with harmonic periods share one hrtimer */
+#define TIMER_GROUP_MAX_TICKS                     64U /* Largest period/base ratio accepted by a timer group */
 
 
 
 /*****************************/
 /**** Struct definitions *****/
 /*****************************/
-struct char_device_data {
+/* @brief Timer shared by the devices whose timer period is a multiple of base_period_ns */
+struct simtemp_timer_group {
+    struct hrtimer timer;
+    enum hrtimer_mode mode;   /* HRTIMER_MODE_REL or HRTIMER_MODE_REL_SOFT, only devices of the same kind share a timer */
+    int cpu;                  /* CPU the timer is pinned to, -1 when not pinned, only devices of that CPU share it */
+    __u64 base_period_ns;
+    struct list_head members; /* struct simtemp_device, RCU protected, walked by the timer callback */
+    struct list_head node;    /* Entry in simtemp_timer_groups */
+    unsigned int nr_members;
+};
+
+/* @brief Arguments of simtemp_timer_start_local(), run on the CPU a timer is pinned to */
+struct simtemp_timer_start_args {
+    struct hrtimer *timer;
+    ktime_t period;
+    enum hrtimer_mode mode;
+};
+
+/* @brief State of the waveform generator, only used by the timer */
+struct simtemp_waveform_state {
+    __u32 generation; /* Value of simtemp_device.waveform_generation this state belongs to */
+    __u64 prng;       /* xorshift64* state, never 0 */
+    __u32 phase;      /* Position in the SINE and SQUARE period, 2^32 is one period */
+    __u32 phase_step; /* Phase advance per sample */
+    __s32 ramp_mC;
+    bool ramp_rising;
+};
+
+/* @brief Records loaded for SIMTEMP_MODE_REPLAY. write() appends after count and publishes the new records with
+ *        a release store of count, so the timer never sees a record that is being copied from user space.
+ */
+struct simtemp_replay_buffer {
+    __u32 count;
+    struct simtemp_replay_record records[];
+};
+
+/* @brief State of the playback of SIMTEMP_MODE_REPLAY, only used by the timer */
+struct simtemp_replay_state {
+    __u32 generation; /* Value of simtemp_device.replay_generation this state belongs to */
+    __u32 flags;      /* Copy of simtemp_device.replay, refreshed on every expiration */
+    __u32 speed_q16;
+    __u32 position;   /* Next record played */
+    __u64 due_ns;     /* SIMTEMP_REPLAY_ORIGINAL_RATE: timestamp of the next record, 0 when the playback starts */
+    __u32 due_clock;  /* Clock of due_ns */
+};
+
+/* @brief State of the stages of a filter chain, only used by the timer */
+struct simtemp_chain_state {
+    __u32 generation; /* Value of simtemp_device.chain_generation this state belongs to */
+    /* SIMTEMP_CHAIN_EMA */
+    __s64 ema_q16; /* Output in mC, Q16 */
+    bool ema_primed;
+    /* SIMTEMP_CHAIN_MOVING_AVERAGE */
+    __s32 average_history[SIMTEMP_CHAIN_MAX_AVERAGE_WINDOW];
+    __u32 average_pos;
+    __u32 average_count;
+    __s64 average_sum;
+    /* SIMTEMP_CHAIN_MEDIAN */
+    __s32 median_history[SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW];
+    __u32 median_pos;
+    __u32 median_count;
+};
+
+/* @brief State of one simulated sensor, exposed as /dev/simtemp_devN */
+struct simtemp_device {
+    /* Character device variables */
     struct cdev cdev;
+    struct device *dev;
+    unsigned int index; /* N in /dev/simtemp_devN */
+    /* hrtimer variables */
+    struct hrtimer sampling_timer;
+    ktime_t timer_period; /* Written by the thread with SIMTEMP_CONTEXT_THREAD, by the timer otherwise */
+    /* Execution context, SIMTEMP_CONTEXT_*, only changed with the sampling stopped */
+    __u32 context;
+    struct kthread_worker *worker; /* SIMTEMP_CONTEXT_THREAD: thread that takes the samples, NULL otherwise */
+    struct kthread_work sample_work;
+    ktime_t work_expires; /* Expiry of the timer that queued sample_work, the jitter is measured from it */
+    /* CPU the timer and the thread run on and whose node holds the buffers, -1 when not pinned. Only changed with
+     * the sampling stopped */
+    int cpu;
+    /* Timer group variables, only used with timer_sched=1 */
+    struct simtemp_timer_group *group;
+    struct list_head group_node;
+    __u32 group_ticks;     /* Group expirations per sample */
+    __u32 group_countdown; /* Group expirations left until the next sample */
+    /* High-rate sampling, periods shorter than batch_period_ns */
+    __u64 next_sample_ns;   /* Timestamp of the next sample due, 0 when not sampling in batches */
+    __u32 next_sample_clock; /* Clock of next_sample_ns */
+    /* Temperature sensing variables */
+    __s32 temperature_sensor_reading; /* Latest raw reading, before the filter chain */
+    struct simtemp_waveform_state waveform_state;
+    struct simtemp_replay_state replay_state;
+    /* Variables for sysfs */
+    __u64 sampling_period_ns; /* Sampling period in ns, exposed in ms and ns through sysfs */
+    __s32 sysfs_temperature_threshold; /* Threshold in mC, high trip point */
+    __u32 sysfs_hysteresis; /* Hysteresis in mC, the low trip point is the threshold minus this value */
+    bool alarm; /* Alarm state, only changed by the timer */
+    __u32 window_samples; /* Aggregation window limits, see struct simtemp_config */
+    __u64 window_ns;
+    /* Aggregation window being filled, only used by the timer */
+    __u32 window_count;
+    __s32 window_min;
+    __s32 window_max;
+    __s64 window_sum;
+    __u64 window_first_ns;
+    __u64 window_last_ns;
+    __u64 window_first_sequence;
+    atomic_t sysfs_flags; /* SIMTEMP_FLAG_* bits, set by the timer and cleared by read() and sysfs without locks */
+    __u32 sysfs_mode; /* Simulation mode, SIMTEMP_MODE_* */
+    __u32 sysfs_clock; /* Clock of the sample timestamps, SIMTEMP_CLOCK_* */
+    struct simtemp_waveform waveform; /* Shape of the simulated temperature */
+    __u32 waveform_generation; /* Incremented on every change of waveform, restarts waveform_state */
+    struct simtemp_replay replay; /* Playback control of MODE_REPLAY, count and position are not used */
+    __u32 replay_generation; /* Incremented on every SIMTEMP_IOC_SET_REPLAY, restarts replay_state */
+    struct simtemp_replay_buffer __rcu *replay_buffer; /* NULL until the first write(), read by the timer under RCU */
+    struct mutex replay_lock; /* Serializes the writers of replay_buffer */
+    struct simtemp_filter_chain chain; /* Filter chain applied to the raw temperature */
+    __u32 chain_generation; /* Incremented on every change of chain, restarts chain_state */
+    struct simtemp_chain_state chain_state;
+    /* Protects the configuration (sampling time, threshold, hysteresis, mode, clock, window, waveform, replay control
+     * and filter chain). Writers take it with interrupts disabled, the timer and the other readers never take it and
+     * retry their copy if a writer changed the configuration meanwhile */
+    seqlock_t config_lock;
+    /* Latest sample and summary, only written by the timer, readers retry their copy if the timer updated them meanwhile */
+    seqcount_t publish_seq;
+    struct simtemp_sample last_sample;
+    __u32 last_sample_clock; /* Clock used for the timestamp of last_sample */
+    struct simtemp_summary last_summary; /* Latest completed aggregation window */
+    /* Variables for polling */
+    wait_queue_head_t wait_queue_new_sampling_available; /* Woken on every sample, used by the ring consumers */
+    /* Open files, struct simtemp_reader, RCU protected, walked by the timer callback */
+    struct list_head readers;
+    struct mutex readers_lock; /* Serializes the changes of readers and ring_owner */
+    struct simtemp_reader *ring_owner; /* File that mapped the ring, the header has room for one consumer cursor */
+    /* Sample buffers */
+    __u64 sample_sequence;  /* Sequence number assigned to the next sample */
+    struct simtemp_ring_header *ring; /* Shared ring exposed through mmap(), see nxp_simtemp.h */
+    /* Statistics, every CPU updates its own copy without locks and the readers add them up */
+    struct simtemp_stats __percpu *stats;
+    struct dentry *debugfs_dir; /* debugfs/simtemp/simtemp_devN */
+};
+
+/* @brief SIMTEMP_FORMAT_DELTA encoder of one open file, the previous sample and the steps predicted for the next one */
+struct simtemp_delta_state {
+    __u64 sequence;
+    __u64 timestamp_ns;
+    __u64 timestamp_delta;
+    __s32 temp_mC;
+    __s64 temp_delta;
+    __u32 flags;
+    __u32 since_keyframe; /* Samples encoded since the last keyframe, 0 forces a keyframe */
+};
+
+/* @brief State of one open file of /dev/simtemp_devN, stored in file->private_data */
+struct simtemp_reader {
+    struct simtemp_device *simtemp;
+    struct list_head node; /* Entry in simtemp->readers */
+    DECLARE_KFIFO_PTR(sample_fifo, struct simtemp_sample); /* Samples that passed the filter and were not read yet */
+    DECLARE_KFIFO_PTR(summary_fifo, struct simtemp_summary); /* Window summaries not read yet */
+    __u32 format; /* SIMTEMP_FORMAT_*, selects the fifo filled by the timer and drained by read() */
+    struct mutex read_lock; /* Serializes the read() calls, the timer is the only writer of the fifos */
+    struct simtemp_delta_state delta; /* Only used by read() under read_lock */
+    wait_queue_head_t wait_queue; /* Woken when a record is queued into sample_fifo or summary_fifo */
+    bool ring_mapped; /* The file mapped the shared ring, poll() follows the ring instead of sample_fifo */
+    bool wake_pending; /* Samples were queued during the current timer expiration, only used by the timer */
+    /* Threshold events, the timer is the only writer of event_fifo and event_lock serializes the ioctl readers */
+    DECLARE_KFIFO_PTR(event_fifo, struct simtemp_event);
+    spinlock_t event_lock;
+    wait_queue_head_t event_wait_queue; /* Woken when an event is queued, so POLLPRI waiters ignore the samples */
+    __u32 events_lost; /* Events dropped since the last one queued, only used by the timer */
+    /* Subscription filter, SIMTEMP_IOC_SET_FILTER writes it under filter_lock, the timer copies it without locking
+     * and retries if it changed meanwhile */
+    seqlock_t filter_lock;
+    struct simtemp_filter filter;
+    __u32 filter_generation; /* Incremented on every SIMTEMP_IOC_SET_FILTER, restarts the state below */
+    /* State of the filter, only used by the timer */
+    __u32 filter_state_generation; /* Value of filter_generation this state belongs to */
+    __u32 filter_countdown; /* Samples left until the next decimated one */
+    bool filter_has_last;   /* filter_last_mC holds the last delivered sample */
+    __s32 filter_last_mC;
 };
 
 
@@ -54,26 +285,122 @@ struct char_device_data {
 /****************************/
 /* Call-back functions */
 static enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer);
+static enum hrtimer_restart simtemp_group_timer_callback(struct hrtimer *timer);
 static unsigned int simtemp_new_event_poll(struct file *file, poll_table *wait);
+static ssize_t simtemp_read(struct file *file, char __user *buf, size_t count, loff_t *ppos);
+static ssize_t simtemp_read_delta(struct simtemp_reader *reader, char __user *buf, size_t count);
+static unsigned int simtemp_delta_encode(struct simtemp_delta_state *state, const struct simtemp_sample *sample, __u8 *out);
+static unsigned int simtemp_delta_put_varint(__u8 *out, __u64 value);
+static ssize_t simtemp_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
+static int simtemp_open(struct inode *inode, struct file *file);
+static int simtemp_reader_fifos_alloc(struct simtemp_reader *reader, int node);
+static int simtemp_release(struct inode *inode, struct file *file);
+static int simtemp_mmap(struct file *file, struct vm_area_struct *vma);
+static long simtemp_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+/* Sampling functions */
+static __u64 simtemp_take_sample(struct simtemp_device *simtemp);
+static void simtemp_produce_sample(struct simtemp_device *simtemp, __u64 timestamp, const struct simtemp_config *config,
+                                   const struct simtemp_waveform *waveform, const struct simtemp_filter_chain *chain);
+static void simtemp_replay_take(struct simtemp_device *simtemp, __u64 now, const struct simtemp_config *config,
+                               const struct simtemp_waveform *waveform, const struct simtemp_filter_chain *chain);
+static __s32 simtemp_chain_run(struct simtemp_device *simtemp, const struct simtemp_filter_chain *chain, __s32 temperature);
+static void simtemp_window_add(struct simtemp_device *simtemp, const struct simtemp_sample *sample, const struct simtemp_config *config);
+static void simtemp_window_close(struct simtemp_device *simtemp);
+static __u64 simtemp_tick_period_ns(__u64 sampling_period_ns);
+static void simtemp_sampling_start(struct simtemp_device *simtemp);
+static void simtemp_sampling_stop(struct simtemp_device *simtemp);
+static enum hrtimer_mode simtemp_context_timer_mode(__u32 context);
+static int simtemp_context_set(struct simtemp_device *simtemp, __u32 context);
+static int simtemp_cpu_set(struct simtemp_device *simtemp, int cpu);
+static int simtemp_sampling_move(struct simtemp_device *simtemp, __u32 context, int cpu);
+static struct kthread_worker *simtemp_worker_create(struct simtemp_device *simtemp, int cpu);
+static void simtemp_timer_start(struct hrtimer *timer, ktime_t period, enum hrtimer_mode mode, int cpu);
+static void simtemp_timer_start_local(void *data);
+static int simtemp_node(const struct simtemp_device *simtemp);
+static void simtemp_sample_work_queue(struct simtemp_device *simtemp, ktime_t expires);
+static void simtemp_sample_work(struct kthread_work *work);
+static void simtemp_timer_group_join(struct simtemp_device *simtemp);
+static void simtemp_timer_group_leave(struct simtemp_device *simtemp);
+/* Subscription functions */
+static void simtemp_readers_deliver(struct simtemp_device *simtemp, const struct simtemp_sample *sample);
+static void simtemp_readers_wake(struct simtemp_device *simtemp);
+static void simtemp_readers_event(struct simtemp_device *simtemp, const struct simtemp_event *event);
+static void simtemp_readers_summary(struct simtemp_device *simtemp, const struct simtemp_summary *summary);
+static bool simtemp_reader_readable(struct simtemp_reader *reader);
+static bool simtemp_filter_match(struct simtemp_reader *reader, const struct simtemp_sample *sample);
+static int simtemp_filter_set(struct simtemp_reader *reader, const struct simtemp_filter *filter);
+/* Configuration functions */
+static int simtemp_config_apply(struct simtemp_device *simtemp, const struct simtemp_config *config);
+static int simtemp_chain_set(struct simtemp_device *simtemp, const struct simtemp_filter_chain *chain);
+static int simtemp_waveform_set(struct simtemp_device *simtemp, const struct simtemp_waveform *waveform);
+static int simtemp_replay_set(struct simtemp_device *simtemp, const struct simtemp_replay *replay);
+static void simtemp_config_fill(struct simtemp_device *simtemp, struct simtemp_config *config);
+static void simtemp_config_read(struct simtemp_device *simtemp, struct simtemp_config *config);
+static void simtemp_chain_get(struct simtemp_device *simtemp, struct simtemp_filter_chain *chain);
+static void simtemp_waveform_get(struct simtemp_device *simtemp, struct simtemp_waveform *waveform);
+static void simtemp_last_sample_get(struct simtemp_device *simtemp, struct simtemp_sample *sample, __u32 *clock);
+static void simtemp_last_summary_get(struct simtemp_device *simtemp, struct simtemp_summary *summary);
+/* Shared ring functions */
+static void simtemp_ring_publish(struct simtemp_device *simtemp, const struct simtemp_sample *sample);
+/* Statistics functions */
+static unsigned int simtemp_stats_bucket(__u64 ns);
+static void simtemp_stats_timer(struct simtemp_device *simtemp, ktime_t expires, ktime_t start, ktime_t end);
+static void simtemp_stats_read(struct simtemp_device *simtemp, struct simtemp_stats *stats);
+static void simtemp_stats_reset(struct simtemp_device *simtemp);
+static int simtemp_debugfs_stats_show(struct seq_file *m, void *v);
 /* Temperature sensor functions */
-static __u32 simtemp_get_temperature(void);
-static void simtemp_get_timestamp(void);
+static __s32 simtemp_get_temperature(struct simtemp_device *simtemp, __u32 mode, const struct simtemp_waveform *waveform);
+static void simtemp_waveform_restart(struct simtemp_device *simtemp, const struct simtemp_waveform *waveform);
+static __u64 simtemp_prng_next(struct simtemp_waveform_state *state);
+static __s32 simtemp_prng_gaussian(struct simtemp_waveform_state *state, __u32 sigma_mC);
+static bool simtemp_replay_next(struct simtemp_device *simtemp, __s32 *temperature);
+static __u64 simtemp_get_timestamp(__u32 clock);
+/* Device instance functions */
+static struct simtemp_device *simtemp_device_create(unsigned int index, int cpu);
+static long simtemp_ring_alloc(void *unused);
+static void simtemp_device_destroy(struct simtemp_device *simtemp);
 /* Init and Exit module functions */
 static int __init simtemp_module_start(void);
 static void __exit simtemp_module_exit(void);
 /* Sysfs functions */
 static ssize_t simtemp_sysfs_sampling_time_show(struct device *d, struct device_attribute *attr, char *buf);
 static ssize_t simtemp_sysfs_sampling_time_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_sampling_period_ns_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_sampling_period_ns_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
 static ssize_t simtemp_sysfs_temperature_threshold_show(struct device *d, struct device_attribute *attr, char *buf);
 static ssize_t simtemp_sysfs_temperature_threshold_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_hysteresis_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_hysteresis_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
 static ssize_t simtemp_sysfs_timestamp_show(struct device *d, struct device_attribute *attr, char *buf);
-static ssize_t simtemp_sysfs_timestamp_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
 static ssize_t simtemp_sysfs_temp_mc_show(struct device *d, struct device_attribute *attr, char *buf);
-static ssize_t simtemp_sysfs_temp_mc_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
 static ssize_t simtemp_sysfs_flags_show(struct device *d, struct device_attribute *attr, char *buf);
 static ssize_t simtemp_sysfs_flags_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
 static ssize_t simtemp_sysfs_mode_show(struct device *d, struct device_attribute *attr, char *buf);
 static ssize_t simtemp_sysfs_mode_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_clock_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_clock_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_context_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_context_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_cpu_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_cpu_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_window_samples_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_window_samples_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_window_ns_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_window_ns_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_summary_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_seed_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_seed_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_filter_chain_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_filter_chain_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_filter_ema_alpha_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_filter_ema_alpha_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_filter_average_window_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_filter_average_window_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_sysfs_filter_median_window_show(struct device *d, struct device_attribute *attr, char *buf);
+static ssize_t simtemp_sysfs_filter_median_window_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count);
+static ssize_t simtemp_timer_expirations_show(const struct class *c, const struct class_attribute *attr, char *buf);
+static __u64 simtemp_timer_expirations_read(void);
+static ssize_t simtemp_timer_expirations_per_sec_show(const struct class *c, const struct class_attribute *attr, char *buf);
 
 
 
@@ -81,30 +408,69 @@ static ssize_t simtemp_sysfs_mode_store(struct device *d, struct device_attribut
 /**** Static variables definitions *****/
 /***************************************/
 
-/* hrtimer variables */
-static struct hrtimer simtemp_sampling_timer;
-static ktime_t simtemp_timer_period;
-/* Temperature sensing variables */
-static __s32 simtemp_temperature_sensor_reading = 32000U;
-static bool  simtemp_temperature_sensor_increment_flag = true; // True:temperature is incremented, False:temperature is decremented
+/* Module parameters */
+static unsigned int nr_devices = 1;
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices, "Number of simulated sensors, each one exposed as /dev/simtemp_devN (1 to 1024)");
+static unsigned int timer_sched = TIMER_SCHED_PER_DEVICE;
+module_param(timer_sched, uint, 0444);
+MODULE_PARM_DESC(timer_sched, "0: one hrtimer per device, 1: devices with harmonic periods share one hrtimer");
+static unsigned long timer_slack_ns;
+module_param(timer_slack_ns, ulong, 0444);
+MODULE_PARM_DESC(timer_slack_ns, "Slack given to the sampling timers so that the kernel can coalesce their expirations");
+static unsigned long batch_period_ns = DEFAULT_BATCH_PERIOD_NS;
+module_param(batch_period_ns, ulong, 0444);
+MODULE_PARM_DESC(batch_period_ns, "Sampling periods shorter than this are served by a timer of this period that takes every sample due at once");
+static bool spread_isolated;
+module_param(spread_isolated, bool, 0444);
+MODULE_PARM_DESC(spread_isolated, "Pin the devices round-robin to the CPUs isolated with isolcpus=, the same as writing simtemp_sysfs_cpu");
+/* Timer groups, the mutex serializes the membership changes and the start and stop of the sampling of every device */
+static LIST_HEAD(simtemp_timer_groups);
+static DEFINE_MUTEX(simtemp_timer_groups_lock);
+/* Sampling timer expirations of every device and group, every CPU counts its own and the readers add them up */
+static DEFINE_PER_CPU(__u64, simtemp_timer_expirations);
+static DEFINE_MUTEX(simtemp_rate_lock);
+static __u64 simtemp_rate_last_expirations; /* Value of simtemp_timer_expirations at the previous rate read */
+static __u64 simtemp_rate_last_time_ns;     /* Time of the previous rate read */
+/* debugfs/simtemp, parent of the directory of every device */
+static struct dentry *simtemp_debugfs_root;
+/* CPUs the devices are spread over with spread_isolated, only used while loading */
+static struct cpumask simtemp_spread_cpus __initdata;
 /* Character device variables */
 static dev_t dev_nr;
 /* Variables for sysfs */
 static struct class *simtemp_class;
-static struct device *simtemp_dev;
-static __u32 simtemp_sysfs_sampling_time = 200; /* sampling time initialized to 200ms */
-static __s32 simtemp_sysfs_temperature_threshold = 40000; /* Threshold in mC */
-static char simtemp_sysfs_timestamp[100]; /* Timestamp */
-static __u32 simtemp_sysfs_temp_mC; /* Measured temperature in mC */
-static __u32 simtemp_sysfs_flags; /* Flags */
-static __u32 simtemp_sysfs_mode = 0; /* Mode, possible values: 0 = Normal, 1 = Noisy, 2 = Ramp */
-/* Variables for polling */
-static wait_queue_head_t wait_queue_new_sampling_available;
-static wait_queue_head_t wait_queue_thres_cross;
-/* Character device data */
-static struct char_device_data simtemp_char_dev_data;
+/* Simulated sensors, nr_devices entries */
+static struct simtemp_device **simtemp_devices;
+/* Waveform generator, one period of sin() in Q15. simtemp_get_temperature() interpolates between the entries */
+static const __s16 simtemp_sine_table[SIMTEMP_SINE_TABLE_SIZE] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285, 32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+    30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+    23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+    12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179, 6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+    0, -804, -1608, -2410, -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790, -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+    -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+    -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683, -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+    -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011, -3212, -2410, -1608, -804,
+};
 /* File Operations */
 static const struct file_operations chardev_fops = {
+    .owner = THIS_MODULE,
+    .open = simtemp_open,
+    .release = simtemp_release,
+    .read = simtemp_read,
+    .write = simtemp_write,
+    .mmap = simtemp_mmap,
+    .unlocked_ioctl = simtemp_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     .poll = simtemp_new_event_poll
 };
 
@@ -114,11 +480,56 @@ static const struct file_operations chardev_fops = {
 /**** Device attribute asignation ***/
 /************************************/
 DEVICE_ATTR(simtemp_sysfs_sampling_time, 0660, simtemp_sysfs_sampling_time_show, simtemp_sysfs_sampling_time_store);
+DEVICE_ATTR(simtemp_sysfs_sampling_period_ns, 0660, simtemp_sysfs_sampling_period_ns_show, simtemp_sysfs_sampling_period_ns_store);
 DEVICE_ATTR(simtemp_sysfs_temperature_threshold, 0660, simtemp_sysfs_temperature_threshold_show, simtemp_sysfs_temperature_threshold_store);
-DEVICE_ATTR(simtemp_sysfs_timestamp, 0660, simtemp_sysfs_timestamp_show, simtemp_sysfs_timestamp_store);
-DEVICE_ATTR(simtemp_sysfs_temp_mC, 0660, simtemp_sysfs_temp_mc_show, simtemp_sysfs_temp_mc_store);
+DEVICE_ATTR(simtemp_sysfs_hysteresis, 0660, simtemp_sysfs_hysteresis_show, simtemp_sysfs_hysteresis_store);
+DEVICE_ATTR(simtemp_sysfs_timestamp, 0440, simtemp_sysfs_timestamp_show, NULL);
+DEVICE_ATTR(simtemp_sysfs_temp_mC, 0440, simtemp_sysfs_temp_mc_show, NULL);
 DEVICE_ATTR(simtemp_sysfs_flags, 0660, simtemp_sysfs_flags_show, simtemp_sysfs_flags_store);
 DEVICE_ATTR(simtemp_sysfs_mode, 0660, simtemp_sysfs_mode_show, simtemp_sysfs_mode_store);
+DEVICE_ATTR(simtemp_sysfs_clock, 0660, simtemp_sysfs_clock_show, simtemp_sysfs_clock_store);
+DEVICE_ATTR(simtemp_sysfs_context, 0660, simtemp_sysfs_context_show, simtemp_sysfs_context_store);
+DEVICE_ATTR(simtemp_sysfs_cpu, 0660, simtemp_sysfs_cpu_show, simtemp_sysfs_cpu_store);
+DEVICE_ATTR(simtemp_sysfs_window_samples, 0660, simtemp_sysfs_window_samples_show, simtemp_sysfs_window_samples_store);
+DEVICE_ATTR(simtemp_sysfs_window_ns, 0660, simtemp_sysfs_window_ns_show, simtemp_sysfs_window_ns_store);
+DEVICE_ATTR(simtemp_sysfs_summary, 0440, simtemp_sysfs_summary_show, NULL);
+DEVICE_ATTR(simtemp_sysfs_seed, 0660, simtemp_sysfs_seed_show, simtemp_sysfs_seed_store);
+DEVICE_ATTR(simtemp_sysfs_filter_chain, 0660, simtemp_sysfs_filter_chain_show, simtemp_sysfs_filter_chain_store);
+DEVICE_ATTR(simtemp_sysfs_filter_ema_alpha, 0660, simtemp_sysfs_filter_ema_alpha_show, simtemp_sysfs_filter_ema_alpha_store);
+DEVICE_ATTR(simtemp_sysfs_filter_average_window, 0660, simtemp_sysfs_filter_average_window_show, simtemp_sysfs_filter_average_window_store);
+DEVICE_ATTR(simtemp_sysfs_filter_median_window, 0660, simtemp_sysfs_filter_median_window_show, simtemp_sysfs_filter_median_window_store);
+
+/* Attributes created along with every device */
+static struct attribute *simtemp_attrs[] = {
+    &dev_attr_simtemp_sysfs_sampling_time.attr,
+    &dev_attr_simtemp_sysfs_sampling_period_ns.attr,
+    &dev_attr_simtemp_sysfs_temperature_threshold.attr,
+    &dev_attr_simtemp_sysfs_hysteresis.attr,
+    &dev_attr_simtemp_sysfs_timestamp.attr,
+    &dev_attr_simtemp_sysfs_temp_mC.attr,
+    &dev_attr_simtemp_sysfs_flags.attr,
+    &dev_attr_simtemp_sysfs_mode.attr,
+    &dev_attr_simtemp_sysfs_clock.attr,
+    &dev_attr_simtemp_sysfs_context.attr,
+    &dev_attr_simtemp_sysfs_cpu.attr,
+    &dev_attr_simtemp_sysfs_window_samples.attr,
+    &dev_attr_simtemp_sysfs_window_ns.attr,
+    &dev_attr_simtemp_sysfs_summary.attr,
+    &dev_attr_simtemp_sysfs_seed.attr,
+    &dev_attr_simtemp_sysfs_filter_chain.attr,
+    &dev_attr_simtemp_sysfs_filter_ema_alpha.attr,
+    &dev_attr_simtemp_sysfs_filter_average_window.attr,
+    &dev_attr_simtemp_sysfs_filter_median_window.attr,
+    NULL
+};
+ATTRIBUTE_GROUPS(simtemp);
+
+/* Statistics file of every device in debugfs */
+DEFINE_SHOW_ATTRIBUTE(simtemp_debugfs_stats);
+
+/* Attributes of the class, shared by all the devices */
+CLASS_ATTR_RO(simtemp_timer_expirations);
+CLASS_ATTR_RO(simtemp_timer_expirations_per_sec);
 
 
 
@@ -129,11 +540,26 @@ DEVICE_ATTR(simtemp_sysfs_mode, 0660, simtemp_sysfs_mode_show, simtemp_sysfs_mod
 static int __init simtemp_module_start(void)
 {
     int chr_dev_status;
+    unsigned int index;
+    int spread_cpu = -1; /* Isolated CPU given to the previous device, -1 before the first one */
+    int cpu;
 
     printk(KERN_INFO "Initializing simtemp module.\n");
 
+    if((nr_devices == 0U) || (nr_devices > MAX_DEV))
+    {
+        printk(KERN_ERR "simtemp - nr_devices must be between 1 and %u\n", MAX_DEV);
+        return -EINVAL;
+    }
+
+    if((batch_period_ns < SIMTEMP_SAMPLING_PERIOD_MIN_NS) || (batch_period_ns > BATCH_PERIOD_MAX_NS))
+    {
+        printk(KERN_ERR "simtemp - batch_period_ns must be between %llu and %lu\n", SIMTEMP_SAMPLING_PERIOD_MIN_NS, BATCH_PERIOD_MAX_NS);
+        return -EINVAL;
+    }
+
     /* allocate chardev region and indicate the number of devices  */
-    chr_dev_status = alloc_chrdev_region(&dev_nr, 0, MAX_DEV, "nxp_simtemp");
+    chr_dev_status = alloc_chrdev_region(&dev_nr, 0, nr_devices, "nxp_simtemp");
     if(chr_dev_status != 0)
     {
         printk(KERN_ERR "simtemp - Error allocating the device number\n");
@@ -146,83 +572,86 @@ static int __init simtemp_module_start(void)
     {
         printk(KERN_ERR "simtemp - Error creating class\n");
         chr_dev_status = PTR_ERR(simtemp_class);
-        unregister_chrdev_region(dev_nr, MAX_DEV);
+        unregister_chrdev_region(dev_nr, nr_devices);
         return chr_dev_status;
     }
-    
-    /* Init a new device */
-    cdev_init(&simtemp_char_dev_data.cdev, &chardev_fops);
 
-    /* Add device to the system */
-    cdev_add(&simtemp_char_dev_data.cdev, MKDEV(MAJOR(dev_nr), 0), 1);
-
-    /* Create a device */
-    simtemp_dev = device_create(simtemp_class, NULL, dev_nr, NULL, "simtemp_dev%d", MINOR(dev_nr));
-    if(IS_ERR(simtemp_dev))
+    if(timer_sched > TIMER_SCHED_GROUPED)
     {
-        printk(KERN_ERR "simtemp - Error creating device\n");
-        chr_dev_status = PTR_ERR(simtemp_dev);
+        printk(KERN_ERR "simtemp - timer_sched must be 0 or 1\n");
         class_destroy(simtemp_class);
-        return chr_dev_status;
+        unregister_chrdev_region(dev_nr, nr_devices);
+        return -EINVAL;
     }
 
-    /* Add the attributes to the device */
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_sampling_time);
-    if(chr_dev_status != 0)
-    {
-        printk(KERN_ERR "simtemp - Error creating sampling_time attribute\n");
-        device_destroy(simtemp_class, dev_nr);
-        return chr_dev_status;
-    }
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_temperature_threshold);
-    if(chr_dev_status != 0)
+    /* Add the timer statistics to the class */
+    chr_dev_status = class_create_file(simtemp_class, &class_attr_simtemp_timer_expirations);
+    if(chr_dev_status == 0)
     {
-        printk(KERN_ERR "simtemp - Error creating temperature_threshold attribute\n");
-        device_destroy(simtemp_class, dev_nr);
-        return chr_dev_status;
+        chr_dev_status = class_create_file(simtemp_class, &class_attr_simtemp_timer_expirations_per_sec);
     }
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_timestamp);
     if(chr_dev_status != 0)
     {
-        printk(KERN_ERR "simtemp - Error creating timestamp attribute\n");
-        device_destroy(simtemp_class, dev_nr);
+        printk(KERN_ERR "simtemp - Error creating timer statistics attributes\n");
+        class_destroy(simtemp_class);
+        unregister_chrdev_region(dev_nr, nr_devices);
         return chr_dev_status;
     }
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_temp_mC);
-    if(chr_dev_status != 0)
+    simtemp_rate_last_time_ns = ktime_get_ns();
+
+    simtemp_devices = kcalloc(nr_devices, sizeof(*simtemp_devices), GFP_KERNEL);
+    if(simtemp_devices == NULL)
     {
-        printk(KERN_ERR "simtemp - Error creating temp_mc attribute\n");
-        device_destroy(simtemp_class, dev_nr);
-        return chr_dev_status;
+        class_destroy(simtemp_class);
+        unregister_chrdev_region(dev_nr, nr_devices);
+        return -ENOMEM;
     }
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_flags);
-    if(chr_dev_status != 0)
+
+    /* debugfs is optional, the devices work without it */
+    simtemp_debugfs_root = debugfs_create_dir("simtemp", NULL);
+
+    /* The CPUs isolated from the scheduler domains (isolcpus=) are the ones the consumers don't run on */
+    if(spread_isolated)
     {
-        printk(KERN_ERR "simtemp - Error creating flags attribute\n");
-        device_destroy(simtemp_class, dev_nr);
-        return chr_dev_status;
+        cpumask_andnot(&simtemp_spread_cpus, cpu_online_mask, housekeeping_cpumask(HK_TYPE_DOMAIN));
+        if(cpumask_empty(&simtemp_spread_cpus))
+        {
+            printk(KERN_WARNING "simtemp - spread_isolated: there are no isolated CPUs, the devices are not pinned\n");
+        }
     }
-    chr_dev_status = device_create_file(simtemp_dev, &dev_attr_simtemp_sysfs_mode);
-    if(chr_dev_status != 0)
+
+    /* Create every simulated sensor, on error the ones already created are removed */
+    for(index = 0U; index < nr_devices; index++)
     {
-        printk(KERN_ERR "simtemp - Error creating mode attribute\n");
-        device_destroy(simtemp_class, dev_nr);
-        return chr_dev_status;
+        cpu = -1;
+        if(spread_isolated && !cpumask_empty(&simtemp_spread_cpus))
+        {
+            /* Round-robin over the isolated CPUs */
+            spread_cpu = cpumask_next(spread_cpu, &simtemp_spread_cpus);
+            if(spread_cpu >= nr_cpu_ids)
+            {
+                spread_cpu = cpumask_first(&simtemp_spread_cpus);
+            }
+            cpu = spread_cpu;
+        }
+        simtemp_devices[index] = simtemp_device_create(index, cpu);
+        if(IS_ERR(simtemp_devices[index]))
+        {
+            printk(KERN_ERR "simtemp - Error creating device %u\n", index);
+            chr_dev_status = PTR_ERR(simtemp_devices[index]);
+            while(index > 0U)
+            {
+                index--;
+                simtemp_device_destroy(simtemp_devices[index]);
+            }
+            debugfs_remove_recursive(simtemp_debugfs_root);
+            kfree(simtemp_devices);
+            class_destroy(simtemp_class);
+            unregister_chrdev_region(dev_nr, nr_devices);
+            return chr_dev_status;
+        }
     }
 
-    /* Init the waitqueue */
-    init_waitqueue_head(&wait_queue_new_sampling_available);
-    init_waitqueue_head(&wait_queue_thres_cross);
-
-    /* Define the delay time */
-    simtemp_timer_period = ktime_set(0, simtemp_sysfs_sampling_time * 1000000);
-    /* Initialize the hrtimer */
-    hrtimer_init(&simtemp_sampling_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-    /* Set the callback function */
-    simtemp_sampling_timer.function = simtemp_timer_callback;
-    /* Start the hrtimer */
-    hrtimer_start(&simtemp_sampling_timer, simtemp_timer_period, HRTIMER_MODE_REL);
-
     return 0;
 }
 
@@ -231,255 +660,3091 @@ static int __init simtemp_module_start(void)
 /* @brief Operation that unloads the module */
 static void __exit simtemp_module_exit(void)
 {
-    /* Cancel the hrtimer if it's still active */
-    hrtimer_cancel(&simtemp_sampling_timer);
+    unsigned int index;
+
+    /* Stop and release every simulated sensor */
+    for(index = 0U; index < nr_devices; index++)
+    {
+        simtemp_device_destroy(simtemp_devices[index]);
+    }
+    debugfs_remove_recursive(simtemp_debugfs_root);
+    kfree(simtemp_devices);
     printk(KERN_INFO "simtemp module unloaded.\n");
 
     /* Release the objects used for sysfs interface */
-    device_remove_file(simtemp_dev, &dev_attr_simtemp_sysfs_sampling_time);
-    device_destroy(simtemp_class, dev_nr);
+    class_remove_file(simtemp_class, &class_attr_simtemp_timer_expirations_per_sec);
+    class_remove_file(simtemp_class, &class_attr_simtemp_timer_expirations);
     class_destroy(simtemp_class);
-    unregister_chrdev_region(dev_nr, MAX_DEV);
+    unregister_chrdev_region(dev_nr, nr_devices);
 }
 
 
 
-/* @brief Timer callback function */
-static enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer)
+/* @brief Creates the simulated sensor number index: buffers, character device, sysfs attributes and timer.
+ *        cpu is the CPU the sampling is pinned to, -1 to leave it unpinned.
+ */
+static struct simtemp_device *simtemp_device_create(unsigned int index, int cpu)
 {
-    /* timesatmp measurement */
-    simtemp_get_timestamp();
-    printk(KERN_INFO "The timestamp is: %s\n", simtemp_sysfs_timestamp);
-    /* Get the temperature reading and store it into simtemp_sysfs_temp_mC */
-    simtemp_sysfs_temp_mC = simtemp_get_temperature();
-    printk(KERN_INFO "The temperature is: %u\n", simtemp_sysfs_temp_mC);
-    /* Notify that there is a new sample available by setting bit 0 */
-    simtemp_sysfs_flags = simtemp_sysfs_flags | 0x1U;
-    wake_up(&wait_queue_new_sampling_available);
-    /* Check if the temperature has crossed the defined threshold */
-    if(simtemp_sysfs_temp_mC > simtemp_sysfs_temperature_threshold)
-    {
-        printk(KERN_INFO "The temperature has crossed the define threshold");
-        /* Set bit 1 of flags variable to 1 indicating that the threshold has been crossed */
-        simtemp_sysfs_flags = simtemp_sysfs_flags | 0x2;
-        /* Notify that the threshold has been crossed */
-        wake_up(&wait_queue_thres_cross);
+    struct simtemp_device *simtemp;
+    dev_t devt = MKDEV(MAJOR(dev_nr), index);
+    int ret_value;
+
+    simtemp = kzalloc_node(sizeof(*simtemp), GFP_KERNEL, (cpu >= 0) ? cpu_to_node(cpu) : NUMA_NO_NODE);
+    if(simtemp == NULL)
+    {
+        return ERR_PTR(-ENOMEM);
+    }
+    simtemp->index = index;
+    simtemp->cpu = cpu;
+    simtemp->temperature_sensor_reading = NORMAL_TEMPERATURE_VALUE;
+    simtemp->waveform.seed = DEFAULT_WAVEFORM_SEED + index;
+    simtemp->waveform.period_ns = DEFAULT_WAVEFORM_PERIOD_NS;
+    simtemp->waveform.offset_mC = NORMAL_TEMPERATURE_VALUE;
+    simtemp->waveform.amplitude_mC = DEFAULT_NOISE_AMPLITUDE_MILI_C;
+    simtemp->waveform.ramp_low_mC = LOWER_THRESHOLD_TEMP_SIMULATION_MILI_C;
+    simtemp->waveform.ramp_high_mC = UPPER_THRESHOLD_TEMP_SIMULATION_MILI_C;
+    simtemp->waveform.ramp_step_mC = TEMP_SIMULATION_INCREMENTS;
+    simtemp_waveform_restart(simtemp, &simtemp->waveform);
+    simtemp->replay.speed_q16 = SIMTEMP_REPLAY_SPEED_ONE;
+    mutex_init(&simtemp->replay_lock);
+    simtemp->sampling_period_ns = DEFAULT_SAMPLING_PERIOD_NS;
+    simtemp->sysfs_temperature_threshold = DEFAULT_TEMPERATURE_THRESHOLD_MILI_C;
+    simtemp->sysfs_hysteresis = DEFAULT_HYSTERESIS_MILI_C;
+    simtemp->window_ns = DEFAULT_WINDOW_NS;
+    simtemp->sysfs_mode = MODE_NORMAL;
+    simtemp->sysfs_clock = SIMTEMP_CLOCK_MONOTONIC;
+    simtemp->chain.ema_alpha_q16 = DEFAULT_CHAIN_EMA_ALPHA_Q16;
+    simtemp->chain.average_window = DEFAULT_CHAIN_AVERAGE_WINDOW;
+    simtemp->chain.median_window = DEFAULT_CHAIN_MEDIAN_WINDOW;
+    seqlock_init(&simtemp->config_lock);
+    seqcount_init(&simtemp->publish_seq);
+    INIT_LIST_HEAD(&simtemp->readers);
+    mutex_init(&simtemp->readers_lock);
+    simtemp->context = SIMTEMP_CONTEXT_HARDIRQ;
+    kthread_init_work(&simtemp->sample_work, simtemp_sample_work);
+
+    /* Init the waitqueue */
+    init_waitqueue_head(&simtemp->wait_queue_new_sampling_available);
+
+    /* Per CPU statistics, alloc_percpu() returns them zeroed */
+    simtemp->stats = alloc_percpu(struct simtemp_stats);
+    if(simtemp->stats == NULL)
+    {
+        ret_value = -ENOMEM;
+        goto free_device;
+    }
+
+    /* Allocate the shared ring, vmalloc_user() returns zeroed memory that can be mapped into user space. It takes
+     * the pages of the node it runs on, so a pinned device allocates it from its CPU. The ring may be mapped, it
+     * stays on this node when the device is moved to another CPU later */
+    if(cpu >= 0)
+    {
+        simtemp->ring = (struct simtemp_ring_header *)work_on_cpu(cpu, simtemp_ring_alloc, NULL);
     }
     else
     {
-        simtemp_sysfs_flags = simtemp_sysfs_flags & 0x1;
+        simtemp->ring = (struct simtemp_ring_header *)simtemp_ring_alloc(NULL);
     }
-    /* Restarting timer using the indicated time on simtemp_timer_period variable */
-    simtemp_timer_period = ktime_set(0, simtemp_sysfs_sampling_time * 1000000);
-    hrtimer_forward_now(timer, simtemp_timer_period);
-    return HRTIMER_RESTART;
+    if(simtemp->ring == NULL)
+    {
+        ret_value = -ENOMEM;
+        goto free_stats;
+    }
+    simtemp->ring->magic = SIMTEMP_RING_MAGIC;
+    simtemp->ring->version = SIMTEMP_RING_VERSION;
+    simtemp->ring->record_size = sizeof(struct simtemp_sample);
+    simtemp->ring->capacity = SIMTEMP_RING_CAPACITY;
+    simtemp->ring->data_offset = SIMTEMP_RING_DATA_OFFSET;
+
+    /* Init a new device and add it to the system */
+    cdev_init(&simtemp->cdev, &chardev_fops);
+    simtemp->cdev.owner = THIS_MODULE;
+    ret_value = cdev_add(&simtemp->cdev, devt, 1);
+    if(ret_value != 0)
+    {
+        goto free_ring;
+    }
+
+    /* Create a device along with its sysfs attributes */
+    simtemp->dev = device_create_with_groups(simtemp_class, NULL, devt, simtemp, simtemp_groups, "simtemp_dev%u", index);
+    if(IS_ERR(simtemp->dev))
+    {
+        ret_value = PTR_ERR(simtemp->dev);
+        goto del_cdev;
+    }
+    simtemp->debugfs_dir = debugfs_create_dir(dev_name(simtemp->dev), simtemp_debugfs_root);
+    debugfs_create_file("stats", 0444, simtemp->debugfs_dir, simtemp, &simtemp_debugfs_stats_fops);
+
+    /* Start sampling, either with an hrtimer of its own or as member of a timer group */
+    mutex_lock(&simtemp_timer_groups_lock);
+    simtemp_sampling_start(simtemp);
+    mutex_unlock(&simtemp_timer_groups_lock);
+
+    return simtemp;
+
+del_cdev:
+    cdev_del(&simtemp->cdev);
+free_ring:
+    vfree(simtemp->ring);
+free_stats:
+    free_percpu(simtemp->stats);
+free_device:
+    kfree(simtemp);
+    return ERR_PTR(ret_value);
 }
 
 
 
-/* @brief Poll callback function for new sample or error event detection */
-static unsigned int simtemp_new_event_poll(struct file *file, poll_table *wait)
+/* @brief Allocates the shared ring of a device, run by work_on_cpu() on the CPU of a pinned device */
+static long simtemp_ring_alloc(void *unused)
 {
-    int ret_value = 0U;
-    poll_wait(file, &wait_queue_new_sampling_available, wait);
-    poll_wait(file, &wait_queue_thres_cross, wait);
-    /* Check if an error has been detected */
-    if(simtemp_sysfs_flags & 0x2U)
+    return (long)vmalloc_user(SIMTEMP_RING_BYTES);
+}
+
+
+
+/* @brief Stops and releases a simulated sensor created by simtemp_device_create() */
+static void simtemp_device_destroy(struct simtemp_device *simtemp)
+{
+    /* Cancel the hrtimer if it's still active */
+    mutex_lock(&simtemp_timer_groups_lock);
+    simtemp_sampling_stop(simtemp);
+    mutex_unlock(&simtemp_timer_groups_lock);
+    if(simtemp->worker != NULL)
     {
-        ret_value = ret_value | POLLPRI;
+        kthread_destroy_worker(simtemp->worker);
+    }
+    debugfs_remove_recursive(simtemp->debugfs_dir);
+    device_destroy(simtemp_class, simtemp->cdev.dev);
+    cdev_del(&simtemp->cdev);
+    kvfree(rcu_dereference_protected(simtemp->replay_buffer, true));
+    vfree(simtemp->ring);
+    free_percpu(simtemp->stats);
+    kfree(simtemp);
+}
+
+
+
+/* @brief Timer callback function of a device that owns its hrtimer */
+static enum hrtimer_restart simtemp_timer_callback(struct hrtimer *timer)
+{
+    struct simtemp_device *simtemp = container_of(timer, struct simtemp_device, sampling_timer);
+    ktime_t expires = hrtimer_get_expires(timer);
+    ktime_t start;
+    __u64 tick_period;
+    __u64 overruns;
+
+    this_cpu_inc(simtemp_timer_expirations);
+    if(simtemp->context == SIMTEMP_CONTEXT_THREAD)
+    {
+        /* The thread takes the samples, accounts them and updates timer_period */
+        simtemp_sample_work_queue(simtemp, expires);
     }
-    /* Check if there is a new sample available */
-    if(simtemp_sysfs_flags & 0x1U)
+    else
     {
-        /* Set the flag back to zero */
-        simtemp_sysfs_flags = simtemp_sysfs_flags & 0x2U;
-        ret_value = ret_value | POLLIN;
+        start = ktime_get();
+        tick_period = simtemp_take_sample(simtemp);
+        simtemp_stats_timer(simtemp, expires, start, ktime_get());
+        simtemp->timer_period = ns_to_ktime(tick_period);
     }
-    return ret_value;
+    /* Restarting timer using the indicated time on simtemp->timer_period variable */
+    overruns = hrtimer_forward_now(timer, READ_ONCE(simtemp->timer_period));
+    /* One period is the expiration being served, the rest were missed */
+    if(overruns > 1U)
+    {
+        this_cpu_add(simtemp->stats->timer_overruns, overruns - 1U);
+    }
+    return HRTIMER_RESTART;
 }
 
 
 
-/* @brief This function simulates the process to obtain temperature samples */
-static __u32 simtemp_get_temperature(void)
+/* @brief Timer callback function of a timer group, samples every member whose period has elapsed in one pass */
+static enum hrtimer_restart simtemp_group_timer_callback(struct hrtimer *timer)
 {
-    __u16 random_value;
-    /* Ramp the temperature up until the threshold defined by UPPER_THRESHOLD_TEMP_SIMULATION_MILI_C is reached
-     * Then ramp the temperature down until the threshold defined by LOWER_THRESHOLD_TEMP_SIMULATION_MILI_C is reached
-    */
-    if(simtemp_sysfs_mode == MODE_RAMP)
+    struct simtemp_timer_group *group = container_of(timer, struct simtemp_timer_group, timer);
+    struct simtemp_device *simtemp;
+    ktime_t expires = hrtimer_get_expires(timer);
+    ktime_t start = ktime_get();
+    ktime_t end;
+    __u64 overruns;
+
+    this_cpu_inc(simtemp_timer_expirations);
+    rcu_read_lock();
+    list_for_each_entry_rcu(simtemp, &group->members, group_node)
     {
-        if(simtemp_temperature_sensor_reading >= UPPER_THRESHOLD_TEMP_SIMULATION_MILI_C)
+        simtemp->group_countdown--;
+        if(simtemp->group_countdown == 0U)
         {
-            simtemp_temperature_sensor_increment_flag = false;
+            simtemp->group_countdown = simtemp->group_ticks;
+            if(simtemp->context == SIMTEMP_CONTEXT_THREAD)
+            {
+                simtemp_sample_work_queue(simtemp, expires);
+                start = ktime_get();
+                continue;
+            }
+            simtemp_take_sample(simtemp);
+            /* The end of a member is the start of the next one, one clock read per member sampled */
+            end = ktime_get();
+            simtemp_stats_timer(simtemp, expires, start, end);
+            start = end;
         }
-        else if(simtemp_temperature_sensor_reading <= LOWER_THRESHOLD_TEMP_SIMULATION_MILI_C)
+    }
+    rcu_read_unlock();
+    overruns = hrtimer_forward_now(timer, ns_to_ktime(group->base_period_ns));
+    /* Missed group periods are charged to every member, whether its own period elapsed or not */
+    if(overruns > 1U)
+    {
+        rcu_read_lock();
+        list_for_each_entry_rcu(simtemp, &group->members, group_node)
         {
-            simtemp_temperature_sensor_increment_flag = true;
+            this_cpu_add(simtemp->stats->timer_overruns, overruns - 1U);
         }
-        else
+        rcu_read_unlock();
+    }
+    return HRTIMER_RESTART;
+}
+
+
+
+/* @brief Takes the samples of a device that are due and notifies its readers once.
+ *        Returns the timer period in ns in effect.
+ */
+static __u64 simtemp_take_sample(struct simtemp_device *simtemp)
+{
+    struct simtemp_config config;
+    struct simtemp_waveform waveform;
+    __u32 waveform_generation;
+    __u32 replay_generation;
+    __u32 replay_flags;
+    __u32 replay_speed;
+    struct simtemp_filter_chain chain;
+    __u32 chain_generation;
+    __u64 sampling_period;
+    __u64 now;
+    __u32 clock;
+    unsigned int seq;
+
+    /* Take a consistent copy of the configuration, it may be changed at once by an ioctl. No lock is taken here,
+     * the copy is simply repeated if a writer was changing the configuration */
+    do
+    {
+        seq = read_seqbegin(&simtemp->config_lock);
+        simtemp_config_fill(simtemp, &config);
+        waveform = simtemp->waveform;
+        waveform_generation = simtemp->waveform_generation;
+        replay_generation = simtemp->replay_generation;
+        replay_flags = simtemp->replay.flags;
+        replay_speed = simtemp->replay.speed_q16;
+        chain = simtemp->chain;
+        chain_generation = simtemp->chain_generation;
+    } while(read_seqretry(&simtemp->config_lock, seq));
+    sampling_period = config.sampling_period_ns;
+    clock = config.clock;
+    if(simtemp->waveform_state.generation != waveform_generation)
+    {
+        simtemp_waveform_restart(simtemp, &waveform);
+        simtemp->waveform_state.generation = waveform_generation;
+    }
+    if(simtemp->replay_state.generation != replay_generation)
+    {
+        memset(&simtemp->replay_state, 0, sizeof(simtemp->replay_state));
+        simtemp->replay_state.generation = replay_generation;
+    }
+    simtemp->replay_state.flags = replay_flags;
+    simtemp->replay_state.speed_q16 = replay_speed;
+    /* The periodic shapes advance one sampling period per sample, whatever the jitter of the timer.
+     * Only the low 32 bits of the step matter, the phase wraps once per waveform period */
+    if((config.mode == MODE_SINE) || (config.mode == MODE_SQUARE))
+    {
+        simtemp->waveform_state.phase_step = (__u32)mul_u64_u64_div_u64(sampling_period, 1ULL << 32, waveform.period_ns);
+    }
+    /* The history of the previous chain means nothing to the new one */
+    if(simtemp->chain_state.generation != chain_generation)
+    {
+        memset(&simtemp->chain_state, 0, sizeof(simtemp->chain_state));
+        simtemp->chain_state.generation = chain_generation;
+    }
+
+    /* Raw timestamp, it is only formatted when simtemp_sysfs_timestamp is read */
+    now = simtemp_get_timestamp(clock);
+    if((config.mode == MODE_REPLAY) && (replay_flags & SIMTEMP_REPLAY_ORIGINAL_RATE))
+    {
+        /* The records set their own timing, the sampling period is only the resolution of the playback */
+        simtemp->next_sample_ns = 0U;
+        simtemp_replay_take(simtemp, now, &config, &waveform, &chain);
+    }
+    else if(sampling_period >= batch_period_ns)
+    {
+        /* One sample per expiration, stamped with the time it was taken */
+        simtemp->next_sample_ns = 0U;
+        simtemp_produce_sample(simtemp, now, &config, &waveform, &chain);
+    }
+    else
+    {
+        /* High-rate mode: the timer ticks every batch_period_ns and takes every sample that became due since
+         * the previous tick, spaced exactly one sampling period apart */
+        if((simtemp->next_sample_ns == 0U) || (simtemp->next_sample_clock != clock))
         {
-            /* Do Nothing */
+            simtemp->next_sample_ns = now;
+            simtemp->next_sample_clock = clock;
         }
-
-        if(simtemp_temperature_sensor_increment_flag == true)
+        /* Do not try to catch up more than one buffer worth of samples */
+        if((simtemp->next_sample_ns <= now) && ((now - simtemp->next_sample_ns) >= (sampling_period * SIMTEMP_BATCH_MAX_SAMPLES)))
         {
-            simtemp_temperature_sensor_reading = simtemp_temperature_sensor_reading + TEMP_SIMULATION_INCREMENTS;
+            this_cpu_add(simtemp->stats->samples_skipped,
+                         div64_u64(now - simtemp->next_sample_ns, sampling_period) + 1U - SIMTEMP_BATCH_MAX_SAMPLES);
+            simtemp->next_sample_ns = now - (sampling_period * (SIMTEMP_BATCH_MAX_SAMPLES - 1U));
         }
-        else
+        while(simtemp->next_sample_ns <= now)
         {
-            simtemp_temperature_sensor_reading = simtemp_temperature_sensor_reading - TEMP_SIMULATION_INCREMENTS;
+            simtemp_produce_sample(simtemp, simtemp->next_sample_ns, &config, &waveform, &chain);
+            simtemp->next_sample_ns = simtemp->next_sample_ns + sampling_period;
         }
     }
-    /* Generate a random number and add it to the temperature to simulate a noisy environment */
-    else if (simtemp_sysfs_mode == MODE_NOISY)
+
+    /* Wake up the readers that received samples, once per expiration however many samples were taken */
+    simtemp_readers_wake(simtemp);
+    /* Notify the ring consumers that there are new samples available */
+    wake_up(&simtemp->wait_queue_new_sampling_available);
+    return simtemp_tick_period_ns(sampling_period);
+}
+
+
+
+/* @brief Simulates one sample taken at timestamp, runs it through the filter chain, publishes it in the ring and
+ *        queues it for the readers without waking them up. Only a transition of the alarm queues an event and wakes
+ *        up the POLLPRI waiters.
+ */
+static void simtemp_produce_sample(struct simtemp_device *simtemp, __u64 timestamp, const struct simtemp_config *config,
+                                   const struct simtemp_waveform *waveform, const struct simtemp_filter_chain *chain)
+{
+    struct simtemp_sample sample;
+    struct simtemp_event event;
+    __s32 threshold = config->threshold_mC;
+    __u32 hysteresis = config->hysteresis_mC;
+    __s32 temperature;
+    __u32 flags;
+    bool transition = false;
+
+    /* Get the temperature reading and filter it. Everything downstream, the threshold check included, sees the
+     * filtered value */
+    temperature = simtemp_get_temperature(simtemp, config->mode, waveform);
+    temperature = simtemp_chain_run(simtemp, chain, temperature);
+    /* The alarm is raised above the threshold and only cleared below threshold - hysteresis, so a temperature
+     * oscillating around the threshold does not produce a transition on every sample */
+    memset(&event, 0, sizeof(event));
+    if((!simtemp->alarm) && (temperature > threshold))
+    {
+        simtemp->alarm = true;
+        event.type = SIMTEMP_EVENT_RISING;
+        event.trip_mC = threshold;
+        transition = true;
+    }
+    else if(simtemp->alarm && ((__s64)temperature < ((__s64)threshold - hysteresis)))
+    {
+        simtemp->alarm = false;
+        event.type = SIMTEMP_EVENT_FALLING;
+        event.trip_mC = (__s32)((__s64)threshold - hysteresis);
+        transition = true;
+    }
+    /* Bit 0 tells that there is a new sample available and bit 1 follows the alarm. One atomic operation, read()
+     * may be clearing bit 0 at the same time on another CPU */
+    if(simtemp->alarm)
     {
-        get_random_bytes(&random_value, sizeof(random_value));
-        simtemp_temperature_sensor_reading = NORMAL_TEMPERATURE_VALUE + (__u32)random_value;
+        flags = SIMTEMP_FLAG_NEW_SAMPLE | SIMTEMP_FLAG_THRESHOLD_CROSSED;
+        atomic_or(flags, &simtemp->sysfs_flags);
     }
     else
     {
-        /* A stable temperature reading will be returned */
-        simtemp_temperature_sensor_reading = NORMAL_TEMPERATURE_VALUE;
+        flags = SIMTEMP_FLAG_NEW_SAMPLE;
+        atomic_set(&simtemp->sysfs_flags, flags);
+    }
+    /* Build the binary record */
+    sample.timestamp_ns = timestamp;
+    sample.sequence = simtemp->sample_sequence++;
+    sample.temp_mC = temperature;
+    sample.flags = flags;
+    trace_simtemp_sample(simtemp->index, sample.sequence, sample.timestamp_ns, sample.temp_mC, sample.flags);
+    this_cpu_inc(simtemp->stats->samples_produced);
+    /* Keep the latest sample for SIMTEMP_IOC_GET_SNAPSHOT and sysfs, the timer is the only writer. A reader spins
+     * while the write is in progress, so the thread of SIMTEMP_CONTEXT_THREAD must not be preempted in between */
+    preempt_disable();
+    write_seqcount_begin(&simtemp->publish_seq);
+    simtemp->last_sample = sample;
+    simtemp->last_sample_clock = config->clock;
+    write_seqcount_end(&simtemp->publish_seq);
+    preempt_enable();
+    /* Publish the same record in the shared ring for the mmap() consumers */
+    simtemp_ring_publish(simtemp, &sample);
+    /* Queue the record for the readers whose filter accepts it */
+    simtemp_readers_deliver(simtemp, &sample);
+    /* Aggregate the record into the current window */
+    simtemp_window_add(simtemp, &sample, config);
+    /* Queue the transition for every reader */
+    if(transition)
+    {
+        trace_simtemp_threshold_crossed(simtemp->index, sample.sequence, temperature, event.trip_mC, simtemp->alarm);
+        this_cpu_inc(simtemp->stats->events);
+        event.timestamp_ns = sample.timestamp_ns;
+        event.sequence = sample.sequence;
+        event.temp_mC = temperature;
+        simtemp_readers_event(simtemp, &event);
     }
-
-    return simtemp_temperature_sensor_reading;
 }
 
 
 
-static void simtemp_get_timestamp(void)
+/* @brief Takes every record of the replay trace that became due since the previous expiration, each one stamped
+ *        with its own time: the previous one plus its delta_ns divided by the speed. Called from the timer.
+ */
+static void simtemp_replay_take(struct simtemp_device *simtemp, __u64 now, const struct simtemp_config *config,
+                               const struct simtemp_waveform *waveform, const struct simtemp_filter_chain *chain)
 {
-    ktime_t now_time;
-    struct rtc_time tm;
-    __u64 milliseconds;
-    /*  Retrive the current real time of the system*/
-    now_time = ktime_get_real();
-    tm = rtc_ktime_to_tm(now_time);
-    /* Get the corresponding millisecond values */
-    milliseconds = ktime_to_ms(now_time) & 0x3E7;
-    /* Store the information as string into simtemp_sysfs_timestamp */
-    sprintf(simtemp_sysfs_timestamp, "%d-%d-%d, T%d:%d:%d:%lld", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, milliseconds);
+    struct simtemp_replay_state *state = &simtemp->replay_state;
+    struct simtemp_replay_buffer *buffer;
+    __u32 count;
+    __u32 taken = 0U;
+    __u64 delta;
+
+    rcu_read_lock();
+    buffer = rcu_dereference(simtemp->replay_buffer);
+    count = (buffer != NULL) ? smp_load_acquire(&buffer->count) : 0U;
+    /* The first record is due when the playback starts */
+    if((state->due_ns == 0U) || (state->due_clock != config->clock))
+    {
+        state->due_ns = now;
+        state->due_clock = config->clock;
+    }
+    while((count != 0U) && (state->due_ns <= now) && (taken < SIMTEMP_BATCH_MAX_SAMPLES))
+    {
+        /* Without SIMTEMP_REPLAY_LOOP the playback stops after the last record */
+        if((state->position >= count) && !(state->flags & SIMTEMP_REPLAY_LOOP))
+        {
+            break;
+        }
+        simtemp_produce_sample(simtemp, state->due_ns, config, waveform, chain);
+        taken++;
+        delta = buffer->records[(state->position < count) ? state->position : 0U].delta_ns;
+        if(state->speed_q16 != SIMTEMP_REPLAY_SPEED_ONE)
+        {
+            delta = mul_u64_u64_div_u64(delta, SIMTEMP_REPLAY_SPEED_ONE, state->speed_q16);
+        }
+        state->due_ns = state->due_ns + delta;
+    }
+    rcu_read_unlock();
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_sampling_time */
-static ssize_t simtemp_sysfs_sampling_time_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Runs a raw temperature through the stages of the chain in order and returns the filtered temperature.
+ *        Integer arithmetic only, called from the timer.
+ */
+static __s32 simtemp_chain_run(struct simtemp_device *simtemp, const struct simtemp_filter_chain *chain, __s32 temperature)
 {
-    return sprintf(buf, "%u", simtemp_sysfs_sampling_time);
+    struct simtemp_chain_state *state = &simtemp->chain_state;
+    __s32 sorted[SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW];
+    __s32 value;
+    __s64 delta;
+    __u32 stage;
+    __u32 index;
+    __u32 slot;
+
+    for(stage = 0U; stage < SIMTEMP_CHAIN_MAX_STAGES; stage++)
+    {
+        switch(chain->stages[stage])
+        {
+            case SIMTEMP_CHAIN_EMA:
+                /* y += alpha * (x - y), y kept in Q16 so small steps are not lost to rounding */
+                if(!state->ema_primed)
+                {
+                    state->ema_q16 = (__s64)temperature << 16;
+                    state->ema_primed = true;
+                }
+                /* x - y reaches 2^48 in Q16 for far apart temperatures (replay takes any __s32), times alpha it
+                 * would overflow an __s64, so the magnitude goes through a 128 bit product */
+                delta = ((__s64)temperature << 16) - state->ema_q16;
+                if(delta >= 0)
+                {
+                    state->ema_q16 += (__s64)mul_u64_u32_shr((__u64)delta, chain->ema_alpha_q16, 16);
+                }
+                else
+                {
+                    state->ema_q16 -= (__s64)mul_u64_u32_shr((__u64)-delta, chain->ema_alpha_q16, 16);
+                }
+                temperature = (__s32)((state->ema_q16 + (1 << 15)) >> 16);
+                break;
+
+            case SIMTEMP_CHAIN_MOVING_AVERAGE:
+                /* Running sum over a circular history, the oldest input leaves as the new one enters */
+                if(state->average_count == chain->average_window)
+                {
+                    state->average_sum -= state->average_history[state->average_pos];
+                }
+                else
+                {
+                    state->average_count++;
+                }
+                state->average_history[state->average_pos] = temperature;
+                state->average_sum += temperature;
+                state->average_pos = (state->average_pos + 1U) % chain->average_window;
+                temperature = (__s32)div_s64(state->average_sum, state->average_count);
+                break;
+
+            case SIMTEMP_CHAIN_MEDIAN:
+                if(state->median_count < chain->median_window)
+                {
+                    state->median_count++;
+                }
+                state->median_history[state->median_pos] = temperature;
+                state->median_pos = (state->median_pos + 1U) % chain->median_window;
+                /* The window is at most SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW inputs, an insertion sort of a copy is enough */
+                for(index = 0U; index < state->median_count; index++)
+                {
+                    value = state->median_history[index];
+                    for(slot = index; (slot > 0U) && (sorted[slot - 1U] > value); slot--)
+                    {
+                        sorted[slot] = sorted[slot - 1U];
+                    }
+                    sorted[slot] = value;
+                }
+                temperature = sorted[state->median_count / 2U];
+                break;
+
+            default:
+                break;
+        }
+    }
+    return temperature;
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_sampling_time */
-static ssize_t simtemp_sysfs_sampling_time_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Adds a sample to the aggregation window, closing the window first when the sample falls beyond
+ *        window_ns and afterwards when it reaches window_samples samples. Called from the timer.
+ */
+static void simtemp_window_add(struct simtemp_device *simtemp, const struct simtemp_sample *sample, const struct simtemp_config *config)
 {
-    if(sscanf(buf, "%du", &simtemp_sysfs_sampling_time) != 1)
+    /* Aggregation disabled */
+    if((config->window_samples == 0U) && (config->window_ns == 0U))
     {
-        return -EINVAL;
+        simtemp->window_count = 0U;
+        return;
+    }
+    if((simtemp->window_count != 0U) && (config->window_ns != 0U) &&
+       ((sample->timestamp_ns - simtemp->window_first_ns) >= config->window_ns))
+    {
+        simtemp_window_close(simtemp);
+    }
+    if(simtemp->window_count == 0U)
+    {
+        simtemp->window_min = sample->temp_mC;
+        simtemp->window_max = sample->temp_mC;
+        simtemp->window_sum = 0;
+        simtemp->window_first_ns = sample->timestamp_ns;
+        simtemp->window_first_sequence = sample->sequence;
+    }
+    simtemp->window_min = min(simtemp->window_min, sample->temp_mC);
+    simtemp->window_max = max(simtemp->window_max, sample->temp_mC);
+    simtemp->window_sum = simtemp->window_sum + sample->temp_mC;
+    simtemp->window_last_ns = sample->timestamp_ns;
+    simtemp->window_count++;
+    if((config->window_samples != 0U) && (simtemp->window_count >= config->window_samples))
+    {
+        simtemp_window_close(simtemp);
     }
-    return count;
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_temperature_threshold */
-static ssize_t simtemp_sysfs_temperature_threshold_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Turns the current aggregation window into a summary, keeps it for sysfs and queues it for the readers */
+static void simtemp_window_close(struct simtemp_device *simtemp)
 {
-    return sprintf(buf, "%u", simtemp_sysfs_temperature_threshold);
+    struct simtemp_summary summary;
+
+    summary.first_timestamp_ns = simtemp->window_first_ns;
+    summary.last_timestamp_ns = simtemp->window_last_ns;
+    summary.first_sequence = simtemp->window_first_sequence;
+    summary.count = simtemp->window_count;
+    summary.min_mC = simtemp->window_min;
+    summary.max_mC = simtemp->window_max;
+    summary.mean_mC = (__s32)div64_s64(simtemp->window_sum, simtemp->window_count);
+    simtemp->window_count = 0U;
+    this_cpu_inc(simtemp->stats->summaries);
+
+    preempt_disable();
+    write_seqcount_begin(&simtemp->publish_seq);
+    simtemp->last_summary = summary;
+    write_seqcount_end(&simtemp->publish_seq);
+    preempt_enable();
+    simtemp_readers_summary(simtemp, &summary);
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_temperature_threshold */
-static ssize_t simtemp_sysfs_temperature_threshold_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Returns the timer period used for a sampling period, periods shorter than batch_period_ns are sampled in batches */
+static __u64 simtemp_tick_period_ns(__u64 sampling_period_ns)
 {
-    if(sscanf(buf, "%du", &simtemp_sysfs_temperature_threshold) != 1)
+    if(sampling_period_ns < batch_period_ns)
     {
-        return -EINVAL;
+        return batch_period_ns;
     }
-    return count;
+    return sampling_period_ns;
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_timestamp */
-static ssize_t simtemp_sysfs_timestamp_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Starts sampling a device according to the timer_sched module parameter and its execution context.
+ *        Caller holds simtemp_timer_groups_lock.
+ */
+static void simtemp_sampling_start(struct simtemp_device *simtemp)
 {
-    return sprintf(buf, "%s", simtemp_sysfs_timestamp);
+    struct simtemp_config config;
+    enum hrtimer_mode mode = simtemp_context_timer_mode(simtemp->context);
+
+    if(timer_sched == TIMER_SCHED_GROUPED)
+    {
+        simtemp_timer_group_join(simtemp);
+        return;
+    }
+    /* Define the delay time */
+    simtemp_config_read(simtemp, &config);
+    simtemp->timer_period = ns_to_ktime(simtemp_tick_period_ns(config.sampling_period_ns));
+    /* Initialize the hrtimer */
+    hrtimer_init(&simtemp->sampling_timer, CLOCK_MONOTONIC, mode);
+    /* Set the callback function */
+    simtemp->sampling_timer.function = simtemp_timer_callback;
+    /* Start the hrtimer */
+    simtemp_timer_start(&simtemp->sampling_timer, simtemp->timer_period, mode, simtemp->cpu);
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_timestamp */
-static ssize_t simtemp_sysfs_timestamp_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Stops sampling a device, once it returns neither the timer callbacks nor the thread of the device reference
+ *        it. Caller holds simtemp_timer_groups_lock.
+ */
+static void simtemp_sampling_stop(struct simtemp_device *simtemp)
 {
-    if(sscanf(buf, "%s", simtemp_sysfs_timestamp) != 1)
+    if(timer_sched == TIMER_SCHED_GROUPED)
     {
-        return -EINVAL;
+        simtemp_timer_group_leave(simtemp);
+    }
+    else
+    {
+        hrtimer_cancel(&simtemp->sampling_timer);
+    }
+    /* No timer queues it any more, a sample already handed off is simply not taken */
+    if(simtemp->worker != NULL)
+    {
+        kthread_cancel_work_sync(&simtemp->sample_work);
     }
-    return count;
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_temp_mC */
-static ssize_t simtemp_sysfs_temp_mc_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Returns the hrtimer mode of an execution context. SIMTEMP_CONTEXT_THREAD keeps a hard interrupt timer,
+ *        its callback only queues the work of the thread.
+ */
+static enum hrtimer_mode simtemp_context_timer_mode(__u32 context)
 {
-    return sprintf(buf, "%u", simtemp_sysfs_temp_mC);
+    return (context == SIMTEMP_CONTEXT_SOFTIRQ) ? HRTIMER_MODE_REL_SOFT : HRTIMER_MODE_REL;
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_temp_mC */
-static ssize_t simtemp_sysfs_temp_mc_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Moves the sampling of a device to another execution context, SIMTEMP_CONTEXT_*. Used by
+ *        simtemp_sysfs_context.
+ */
+static int simtemp_context_set(struct simtemp_device *simtemp, __u32 context)
 {
-    if(sscanf(buf, "%du", &simtemp_sysfs_temp_mC) != 1)
+    int ret_value;
+
+    if(context > SIMTEMP_CONTEXT_THREAD)
     {
         return -EINVAL;
     }
-    return count;
+    mutex_lock(&simtemp_timer_groups_lock);
+    ret_value = simtemp_sampling_move(simtemp, context, simtemp->cpu);
+    mutex_unlock(&simtemp_timer_groups_lock);
+    return ret_value;
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_flags */
-static ssize_t simtemp_sysfs_flags_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Pins the sampling of a device to an online CPU, or unpins it with -1. Used by simtemp_sysfs_cpu. */
+static int simtemp_cpu_set(struct simtemp_device *simtemp, int cpu)
 {
-    return sprintf(buf, "%u", simtemp_sysfs_flags);
+    int ret_value;
+
+    if((cpu < -1) || ((cpu >= 0) && ((cpu >= nr_cpu_ids) || !cpu_online(cpu))))
+    {
+        return -EINVAL;
+    }
+    mutex_lock(&simtemp_timer_groups_lock);
+    ret_value = simtemp_sampling_move(simtemp, simtemp->context, cpu);
+    mutex_unlock(&simtemp_timer_groups_lock);
+    return ret_value;
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_flags */
-static ssize_t simtemp_sysfs_flags_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Moves the sampling of a device to another execution context and CPU. The sampling is stopped while the
+ *        timer and the thread are replaced, and the statistics are reset so that they only describe the new
+ *        placement. Caller holds simtemp_timer_groups_lock.
+ */
+static int simtemp_sampling_move(struct simtemp_device *simtemp, __u32 context, int cpu)
 {
-    if(sscanf(buf, "%du", &simtemp_sysfs_flags) != 1)
+    struct kthread_worker *worker = NULL;
+    struct kthread_worker *old_worker;
+
+    if((context == simtemp->context) && (cpu == simtemp->cpu))
     {
-        return -EINVAL;
+        return 0;
     }
-    return count;
+    if(context == SIMTEMP_CONTEXT_THREAD)
+    {
+        worker = simtemp_worker_create(simtemp, cpu);
+        if(IS_ERR(worker))
+        {
+            return PTR_ERR(worker);
+        }
+    }
+    simtemp_sampling_stop(simtemp);
+    old_worker = simtemp->worker;
+    simtemp->worker = worker;
+    simtemp->context = context;
+    WRITE_ONCE(simtemp->cpu, cpu);
+    simtemp_stats_reset(simtemp);
+    simtemp_sampling_start(simtemp);
+
+    /* The old thread has nothing queued since simtemp_sampling_stop() */
+    if(old_worker != NULL)
+    {
+        kthread_destroy_worker(old_worker);
+    }
+    return 0;
 }
 
 
 
-/* @brief Show function for reading the contents of simtemp_sysfs_mode */
-static ssize_t simtemp_sysfs_mode_show(struct device *d, struct device_attribute *attr, char *buf)
+/* @brief Creates the thread of a device with SIMTEMP_CONTEXT_THREAD, bound to cpu unless it's -1 */
+static struct kthread_worker *simtemp_worker_create(struct simtemp_device *simtemp, int cpu)
 {
-    return sprintf(buf, "%u", simtemp_sysfs_mode);
+    struct kthread_worker *worker;
+
+    if(cpu >= 0)
+    {
+        worker = kthread_create_worker_on_cpu(cpu, 0, "simtemp%u", simtemp->index);
+    }
+    else
+    {
+        worker = kthread_create_worker(0, "simtemp%u", simtemp->index);
+    }
+    if(!IS_ERR(worker))
+    {
+        /* Lowest real time priority: ahead of the normal tasks of the host, behind the threaded interrupts */
+        sched_set_fifo_low(worker->task);
+    }
+    return worker;
 }
 
 
 
-/* @brief Define the store function for writing to simtemp_sysfs_mode */
-static ssize_t simtemp_sysfs_mode_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+/* @brief Starts a sampling timer, pinned to cpu unless it's -1. A pinned hrtimer stays on the CPU it was started
+ *        from, restarts from its callback included, so it is started by that CPU. If the CPU went offline the
+ *        timer is started unpinned.
+ */
+static void simtemp_timer_start(struct hrtimer *timer, ktime_t period, enum hrtimer_mode mode, int cpu)
 {
-    if(sscanf(buf, "%du", &simtemp_sysfs_mode) != 1)
+    struct simtemp_timer_start_args args = {
+        .timer = timer,
+        .period = period,
+        .mode = mode | HRTIMER_MODE_PINNED,
+    };
+
+    if((cpu >= 0) && (smp_call_function_single(cpu, simtemp_timer_start_local, &args, 1) == 0))
     {
-        return -EINVAL;
+        return;
     }
-    return count;
+    hrtimer_start_range_ns(timer, period, timer_slack_ns, mode);
+}
+
+
+
+/* @brief Starts a pinned timer on the CPU it runs on, called by simtemp_timer_start() on the target CPU */
+static void simtemp_timer_start_local(void *data)
+{
+    struct simtemp_timer_start_args *args = data;
+
+    hrtimer_start_range_ns(args->timer, args->period, timer_slack_ns, args->mode);
+}
+
+
+
+/* @brief Returns the NUMA node of the CPU of a device, NUMA_NO_NODE when it is not pinned */
+static int simtemp_node(const struct simtemp_device *simtemp)
+{
+    int cpu = READ_ONCE(simtemp->cpu);
+
+    return (cpu >= 0) ? cpu_to_node(cpu) : NUMA_NO_NODE;
+}
+
+
+
+/* @brief Hands the samples due at expires to the thread of the device. Called from the timer: when the thread is
+ *        still busy with a previous expiration nothing more is queued, the high-rate mode catches up on the samples
+ *        due when the thread runs and a period sampled once per expiration loses this sample.
+ */
+static void simtemp_sample_work_queue(struct simtemp_device *simtemp, ktime_t expires)
+{
+    WRITE_ONCE(simtemp->work_expires, expires);
+    if(!kthread_queue_work(simtemp->worker, &simtemp->sample_work))
+    {
+        this_cpu_inc(simtemp->stats->handoffs_missed);
+    }
+}
+
+
+
+/* @brief Work of the thread of a device with SIMTEMP_CONTEXT_THREAD: takes the samples that are due, the same
+ *        as the timer callback does in the other contexts. The jitter accounted goes from the timer expiry to the
+ *        start of the work, so it includes the wake up of the thread.
+ */
+static void simtemp_sample_work(struct kthread_work *work)
+{
+    struct simtemp_device *simtemp = container_of(work, struct simtemp_device, sample_work);
+    ktime_t expires = READ_ONCE(simtemp->work_expires);
+    ktime_t start = ktime_get();
+    __u64 tick_period;
+
+    tick_period = simtemp_take_sample(simtemp);
+    simtemp_stats_timer(simtemp, expires, start, ktime_get());
+    /* Period used by the timer from its next expiration on */
+    WRITE_ONCE(simtemp->timer_period, ns_to_ktime(tick_period));
+}
+
+
+
+/* @brief Adds a device to the timer group of its context and CPU with the largest base period that divides its
+ *        sampling time, a new group is created when none fits. Caller holds simtemp_timer_groups_lock.
+ */
+static void simtemp_timer_group_join(struct simtemp_device *simtemp)
+{
+    struct simtemp_timer_group *group;
+    struct simtemp_timer_group *best_group = NULL;
+    struct simtemp_config config;
+    enum hrtimer_mode mode = simtemp_context_timer_mode(simtemp->context);
+    __u64 tick_period;
+    __u64 ticks;
+
+    simtemp_config_read(simtemp, &config);
+    tick_period = simtemp_tick_period_ns(config.sampling_period_ns);
+
+    list_for_each_entry(group, &simtemp_timer_groups, node)
+    {
+        ticks = div64_u64(tick_period, group->base_period_ns);
+        if((group->mode == mode) && (group->cpu == simtemp->cpu) &&
+           ((ticks * group->base_period_ns) == tick_period) &&
+           (ticks <= TIMER_GROUP_MAX_TICKS) &&
+           ((best_group == NULL) || (group->base_period_ns > best_group->base_period_ns)))
+        {
+            best_group = group;
+        }
+    }
+
+    if(best_group == NULL)
+    {
+        best_group = kzalloc(sizeof(*best_group), GFP_KERNEL);
+        if(best_group == NULL)
+        {
+            /* Fall back to a timer of its own so the device keeps sampling */
+            printk(KERN_ERR "simtemp - Error allocating a timer group, device %u uses its own timer\n", simtemp->index);
+            simtemp->group = NULL;
+            simtemp->timer_period = ns_to_ktime(tick_period);
+            hrtimer_init(&simtemp->sampling_timer, CLOCK_MONOTONIC, mode);
+            simtemp->sampling_timer.function = simtemp_timer_callback;
+            simtemp_timer_start(&simtemp->sampling_timer, simtemp->timer_period, mode, simtemp->cpu);
+            return;
+        }
+        best_group->base_period_ns = tick_period;
+        best_group->mode = mode;
+        best_group->cpu = simtemp->cpu;
+        INIT_LIST_HEAD(&best_group->members);
+        hrtimer_init(&best_group->timer, CLOCK_MONOTONIC, mode);
+        best_group->timer.function = simtemp_group_timer_callback;
+        list_add_tail(&best_group->node, &simtemp_timer_groups);
+    }
+
+    /* The countdown is set before the device becomes visible to the group callback */
+    simtemp->group = best_group;
+    simtemp->group_ticks = (__u32)div64_u64(tick_period, best_group->base_period_ns);
+    simtemp->group_countdown = simtemp->group_ticks;
+    list_add_tail_rcu(&simtemp->group_node, &best_group->members);
+    best_group->nr_members++;
+    if(best_group->nr_members == 1U)
+    {
+        simtemp_timer_start(&best_group->timer, ns_to_ktime(best_group->base_period_ns), best_group->mode, best_group->cpu);
+    }
+}
+
+
+
+/* @brief Removes a device from its timer group, the group is released once it has no members.
+ *        Caller holds simtemp_timer_groups_lock.
+ */
+static void simtemp_timer_group_leave(struct simtemp_device *simtemp)
+{
+    struct simtemp_timer_group *group = simtemp->group;
+
+    if(group == NULL)
+    {
+        /* The device fell back to a timer of its own when it joined */
+        hrtimer_cancel(&simtemp->sampling_timer);
+        return;
+    }
+    list_del_rcu(&simtemp->group_node);
+    group->nr_members--;
+    if(group->nr_members == 0U)
+    {
+        hrtimer_cancel(&group->timer);
+        list_del(&group->node);
+        kfree(group);
+    }
+    else
+    {
+        /* Wait until the group callback can no longer be walking over this device */
+        synchronize_rcu();
+    }
+    simtemp->group = NULL;
+}
+
+
+
+/* @brief Poll callback function for new sample or error event detection */
+static unsigned int simtemp_new_event_poll(struct file *file, poll_table *wait)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+    int ret_value = 0U;
+    /* Files that mapped the ring consume from it, the others are only woken for the samples that passed their filter */
+    if(READ_ONCE(reader->ring_mapped))
+    {
+        poll_wait(file, &simtemp->wait_queue_new_sampling_available, wait);
+    }
+    else
+    {
+        poll_wait(file, &reader->wait_queue, wait);
+    }
+    poll_wait(file, &reader->event_wait_queue, wait);
+    /* Check if threshold events are waiting to be fetched */
+    if(!kfifo_is_empty(&reader->event_fifo))
+    {
+        ret_value = ret_value | POLLPRI;
+    }
+    /* The reader index of the ring tells how far the ring consumer got */
+    if(READ_ONCE(reader->ring_mapped))
+    {
+        if(READ_ONCE(simtemp->ring->reader) != READ_ONCE(simtemp->sample_sequence))
+        {
+            ret_value = ret_value | POLLIN;
+        }
+    }
+    /* Check if there are records waiting to be read */
+    else if(simtemp_reader_readable(reader))
+    {
+        ret_value = ret_value | POLLIN;
+    }
+    return ret_value;
+}
+
+
+
+/* @brief Read callback function, copies as many whole records of the format selected for the file as fit in
+ *        the user buffer
+ */
+static ssize_t simtemp_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+    unsigned int copied;
+    ssize_t delta_ret;
+    int ret_value;
+
+    if(mutex_lock_interruptible(&reader->read_lock))
+    {
+        return -ERESTARTSYS;
+    }
+    /* Only whole records are handed to user space */
+    if(((reader->format == SIMTEMP_FORMAT_SAMPLES) && (count < sizeof(struct simtemp_sample))) ||
+       ((reader->format == SIMTEMP_FORMAT_SUMMARIES) && (count < sizeof(struct simtemp_summary))) ||
+       ((reader->format == SIMTEMP_FORMAT_DELTA) && (count < SIMTEMP_DELTA_RECORD_MAX)))
+    {
+        mutex_unlock(&reader->read_lock);
+        return -EINVAL;
+    }
+    /* Wait until the timer queues a record, unless the file was opened as non-blocking */
+    while(!simtemp_reader_readable(reader))
+    {
+        mutex_unlock(&reader->read_lock);
+        if(file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        if(wait_event_interruptible(reader->wait_queue, simtemp_reader_readable(reader)))
+        {
+            return -ERESTARTSYS;
+        }
+        if(mutex_lock_interruptible(&reader->read_lock))
+        {
+            return -ERESTARTSYS;
+        }
+    }
+    /* kfifo_to_user() rounds the length down to whole records */
+    if(reader->format == SIMTEMP_FORMAT_SUMMARIES)
+    {
+        ret_value = kfifo_to_user(&reader->summary_fifo, buf, count, &copied);
+    }
+    else
+    {
+        if(reader->format == SIMTEMP_FORMAT_DELTA)
+        {
+            delta_ret = simtemp_read_delta(reader, buf, count);
+            ret_value = (delta_ret < 0) ? (int)delta_ret : 0;
+            copied = (delta_ret < 0) ? 0U : (unsigned int)delta_ret;
+        }
+        else
+        {
+            ret_value = kfifo_to_user(&reader->sample_fifo, buf, count, &copied);
+        }
+        /* Clear bit 0 once every pending sample has been consumed */
+        if(kfifo_is_empty(&reader->sample_fifo))
+        {
+            atomic_andnot(SIMTEMP_FLAG_NEW_SAMPLE, &simtemp->sysfs_flags);
+        }
+    }
+    mutex_unlock(&reader->read_lock);
+
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return copied;
+}
+
+
+
+/* @brief Encodes the queued samples into the SIMTEMP_FORMAT_DELTA stream of the file, as many whole records as
+ *        fit in count bytes. The records are staged in a small stack buffer, a sample is only dequeued when the
+ *        longest record still fits. Caller holds reader->read_lock. Returns the bytes copied or -EFAULT.
+ */
+static ssize_t simtemp_read_delta(struct simtemp_reader *reader, char __user *buf, size_t count)
+{
+    __u8 chunk[SIMTEMP_DELTA_CHUNK_BYTES];
+    struct simtemp_sample sample;
+    unsigned int used = 0U;
+    size_t copied = 0U;
+
+    while(((copied + used + SIMTEMP_DELTA_RECORD_MAX) <= count) && kfifo_get(&reader->sample_fifo, &sample))
+    {
+        used += simtemp_delta_encode(&reader->delta, &sample, &chunk[used]);
+        if((used + SIMTEMP_DELTA_RECORD_MAX) > sizeof(chunk))
+        {
+            if(copy_to_user(buf + copied, chunk, used) != 0)
+            {
+                return -EFAULT;
+            }
+            copied += used;
+            used = 0U;
+        }
+    }
+    if(used != 0U)
+    {
+        if(copy_to_user(buf + copied, chunk, used) != 0)
+        {
+            return -EFAULT;
+        }
+        copied += used;
+    }
+    return copied;
+}
+
+
+
+/* @brief Encodes one sample as a keyframe or a delta record, see SIMTEMP_FORMAT_DELTA in nxp_simtemp.h.
+ *        Returns the bytes written at out, at most SIMTEMP_DELTA_RECORD_MAX.
+ */
+static unsigned int simtemp_delta_encode(struct simtemp_delta_state *state, const struct simtemp_sample *sample, __u8 *out)
+{
+    __u64 timestamp_delta = sample->timestamp_ns - state->timestamp_ns;
+    __s64 temp_delta = (__s64)sample->temp_mC - state->temp_mC;
+    __u64 timestamp_error = timestamp_delta - state->timestamp_delta;
+    __s64 temp_error = temp_delta - state->temp_delta;
+    __u64 temp_zigzag = ((__u64)temp_error << 1) ^ (__u64)(temp_error >> 63);
+    __u64 lost = sample->sequence - state->sequence - 1U;
+    unsigned int length;
+    __u8 extension = 0U;
+
+    if(state->since_keyframe == 0U)
+    {
+        out[0] = SIMTEMP_DELTA_KEYFRAME;
+        length = 1U;
+        length += simtemp_delta_put_varint(&out[length], sample->sequence);
+        length += simtemp_delta_put_varint(&out[length], sample->timestamp_ns);
+        length += simtemp_delta_put_varint(&out[length], ((__u64)(__s64)sample->temp_mC << 1) ^ (__u64)((__s64)sample->temp_mC >> 63));
+        length += simtemp_delta_put_varint(&out[length], sample->flags);
+        timestamp_delta = 0U;
+        temp_delta = 0;
+    }
+    else
+    {
+        if(sample->flags != state->flags)
+        {
+            extension |= SIMTEMP_DELTA_EXT_FLAGS;
+        }
+        if(lost != 0U)
+        {
+            extension |= SIMTEMP_DELTA_EXT_LOST;
+        }
+        if(timestamp_error != 0U)
+        {
+            extension |= SIMTEMP_DELTA_EXT_TIMESTAMP;
+        }
+        out[0] = (temp_zigzag < SIMTEMP_DELTA_TEMP_ESCAPE) ? (__u8)temp_zigzag : SIMTEMP_DELTA_TEMP_ESCAPE;
+        length = 1U;
+        if(extension != 0U)
+        {
+            out[0] |= SIMTEMP_DELTA_EXTENDED;
+            out[length++] = extension;
+        }
+        if(extension & SIMTEMP_DELTA_EXT_FLAGS)
+        {
+            length += simtemp_delta_put_varint(&out[length], sample->flags);
+        }
+        if(extension & SIMTEMP_DELTA_EXT_LOST)
+        {
+            length += simtemp_delta_put_varint(&out[length], lost);
+        }
+        if(extension & SIMTEMP_DELTA_EXT_TIMESTAMP)
+        {
+            length += simtemp_delta_put_varint(&out[length], (timestamp_error << 1) ^ (__u64)((__s64)timestamp_error >> 63));
+        }
+        if(temp_zigzag >= SIMTEMP_DELTA_TEMP_ESCAPE)
+        {
+            length += simtemp_delta_put_varint(&out[length], temp_zigzag);
+        }
+    }
+
+    state->sequence = sample->sequence;
+    state->timestamp_ns = sample->timestamp_ns;
+    state->timestamp_delta = timestamp_delta;
+    state->temp_mC = sample->temp_mC;
+    state->temp_delta = temp_delta;
+    state->flags = sample->flags;
+    state->since_keyframe = (state->since_keyframe + 1U) % SIMTEMP_DELTA_KEYFRAME_INTERVAL;
+    return length;
+}
+
+
+
+/* @brief Writes value as a LEB128 varint, returns its length (1 to 10 bytes) */
+static unsigned int simtemp_delta_put_varint(__u8 *out, __u64 value)
+{
+    unsigned int length = 0U;
+
+    while(value >= 0x80U)
+    {
+        out[length++] = (__u8)(value | 0x80U);
+        value >>= 7;
+    }
+    out[length++] = (__u8)value;
+    return length;
+}
+
+
+
+/* @brief kfifo_alloc() of the fifos of a reader on a NUMA node, they are released with kfifo_free() as well */
+static int simtemp_reader_fifos_alloc(struct simtemp_reader *reader, int node)
+{
+    struct simtemp_sample *samples;
+    struct simtemp_event *events;
+    struct simtemp_summary *summaries;
+
+    samples = kmalloc_array_node(SIMTEMP_FIFO_SIZE, sizeof(*samples), GFP_KERNEL, node);
+    events = kmalloc_array_node(SIMTEMP_EVENT_FIFO_SIZE, sizeof(*events), GFP_KERNEL, node);
+    summaries = kmalloc_array_node(SIMTEMP_SUMMARY_FIFO_SIZE, sizeof(*summaries), GFP_KERNEL, node);
+    /* The sizes are powers of 2, so kfifo_init() uses the whole buffers */
+    if((samples == NULL) || (events == NULL) || (summaries == NULL) ||
+       (kfifo_init(&reader->sample_fifo, samples, SIMTEMP_FIFO_SIZE * sizeof(*samples)) != 0) ||
+       (kfifo_init(&reader->event_fifo, events, SIMTEMP_EVENT_FIFO_SIZE * sizeof(*events)) != 0) ||
+       (kfifo_init(&reader->summary_fifo, summaries, SIMTEMP_SUMMARY_FIFO_SIZE * sizeof(*summaries)) != 0))
+    {
+        kfree(summaries);
+        kfree(events);
+        kfree(samples);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+
+
+/* @brief Open callback function, creates the subscription of the new file. By default it receives every sample */
+static int simtemp_open(struct inode *inode, struct file *file)
+{
+    struct simtemp_device *simtemp = container_of(inode->i_cdev, struct simtemp_device, cdev);
+    struct simtemp_reader *reader;
+    int node;
+    int ret_value;
+
+    /* The timer fills the reader, so it lives on the node of the CPU of the device */
+    node = simtemp_node(simtemp);
+    reader = kzalloc_node(sizeof(*reader), GFP_KERNEL, node);
+    if(reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    ret_value = simtemp_reader_fifos_alloc(reader, node);
+    if(ret_value != 0)
+    {
+        kfree(reader);
+        return ret_value;
+    }
+    reader->format = SIMTEMP_FORMAT_SAMPLES;
+    reader->simtemp = simtemp;
+    mutex_init(&reader->read_lock);
+    init_waitqueue_head(&reader->wait_queue);
+    spin_lock_init(&reader->event_lock);
+    init_waitqueue_head(&reader->event_wait_queue);
+    seqlock_init(&reader->filter_lock);
+    reader->filter.type = SIMTEMP_FILTER_NONE;
+    reader->filter_countdown = 1U;
+    file->private_data = reader;
+
+    /* From now on the timer callback queues samples for this reader */
+    mutex_lock(&simtemp->readers_lock);
+    list_add_tail_rcu(&reader->node, &simtemp->readers);
+    mutex_unlock(&simtemp->readers_lock);
+
+    return 0;
+}
+
+
+
+/* @brief Release callback function, removes the subscription of the file */
+static int simtemp_release(struct inode *inode, struct file *file)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+
+    mutex_lock(&simtemp->readers_lock);
+    list_del_rcu(&reader->node);
+    /* Every mapping of the file is gone by now, another file may map the ring */
+    if(simtemp->ring_owner == reader)
+    {
+        simtemp->ring_owner = NULL;
+    }
+    mutex_unlock(&simtemp->readers_lock);
+    /* Wait until the timer callback can no longer be queueing samples for this reader */
+    synchronize_rcu();
+
+    kfifo_free(&reader->summary_fifo);
+    kfifo_free(&reader->event_fifo);
+    kfifo_free(&reader->sample_fifo);
+    kfree(reader);
+    return 0;
+}
+
+
+
+/* @brief Write callback function, appends an array of struct simtemp_replay_record to the replay trace of the
+ *        device. The records are copied to kernel memory here, so the timer never touches user space.
+ */
+static ssize_t simtemp_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+    struct simtemp_replay_buffer *buffer;
+    size_t nr_records;
+    __u32 loaded;
+    ssize_t ret_value;
+
+    if((count == 0U) || ((count % sizeof(struct simtemp_replay_record)) != 0U))
+    {
+        return -EINVAL;
+    }
+    if(mutex_lock_interruptible(&simtemp->replay_lock))
+    {
+        return -ERESTARTSYS;
+    }
+    /* The buffer is allocated at the first write and kept until SIMTEMP_REPLAY_CLEAR */
+    buffer = rcu_dereference_protected(simtemp->replay_buffer, lockdep_is_held(&simtemp->replay_lock));
+    if(buffer == NULL)
+    {
+        buffer = kvzalloc_node(struct_size(buffer, records, SIMTEMP_REPLAY_MAX_RECORDS), GFP_KERNEL, simtemp_node(simtemp));
+        if(buffer == NULL)
+        {
+            ret_value = -ENOMEM;
+            goto unlock;
+        }
+        rcu_assign_pointer(simtemp->replay_buffer, buffer);
+    }
+    /* Take as many records as fit, the records past count are not visible to the timer yet */
+    loaded = buffer->count;
+    nr_records = min_t(size_t, count / sizeof(struct simtemp_replay_record), SIMTEMP_REPLAY_MAX_RECORDS - loaded);
+    if(nr_records == 0U)
+    {
+        ret_value = -ENOSPC;
+        goto unlock;
+    }
+    if(copy_from_user(&buffer->records[loaded], buf, nr_records * sizeof(struct simtemp_replay_record)) != 0)
+    {
+        ret_value = -EFAULT;
+        goto unlock;
+    }
+    smp_store_release(&buffer->count, loaded + (__u32)nr_records);
+    ret_value = (ssize_t)(nr_records * sizeof(struct simtemp_replay_record));
+
+unlock:
+    mutex_unlock(&simtemp->replay_lock);
+    return ret_value;
+}
+
+
+
+/* @brief Mmap callback function, maps the shared sample ring into the caller address space. Only one open file
+ *        of a device can map it, the others get -EBUSY until that file is closed
+ */
+static int simtemp_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+    int ret_value;
+
+    /* The whole ring is mapped from its beginning, the header is needed to locate the slots */
+    if((vma->vm_pgoff != 0U) || ((vma->vm_end - vma->vm_start) > PAGE_ALIGN(SIMTEMP_RING_BYTES)))
+    {
+        return -EINVAL;
+    }
+    mutex_lock(&simtemp->readers_lock);
+    /* The reader cursor of the header belongs to a single consumer */
+    if((simtemp->ring_owner != NULL) && (simtemp->ring_owner != reader))
+    {
+        ret_value = -EBUSY;
+        goto unlock;
+    }
+    ret_value = remap_vmalloc_range(vma, simtemp->ring, 0);
+    if(ret_value != 0)
+    {
+        goto unlock;
+    }
+    simtemp->ring_owner = reader;
+    /* From now on poll() reports POLLIN for this file based on the ring instead of its kfifo */
+    WRITE_ONCE(reader->ring_mapped, true);
+unlock:
+    mutex_unlock(&simtemp->readers_lock);
+    return ret_value;
+}
+
+
+
+/* @brief Queues a sample for every reader whose filter accepts it, simtemp_readers_wake() wakes them up later.
+ *        Called from the timer. If the kfifo of a reader is full the sample is dropped for that reader, it will
+ *        detect the loss through the gap in the sequence numbers.
+ */
+static void simtemp_readers_deliver(struct simtemp_device *simtemp, const struct simtemp_sample *sample)
+{
+    struct simtemp_reader *reader;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(reader, &simtemp->readers, node)
+    {
+        /* Files reading summaries do not pay for the raw samples, SIMTEMP_FORMAT_DELTA encodes them in read() */
+        if(READ_ONCE(reader->format) == SIMTEMP_FORMAT_SUMMARIES)
+        {
+            continue;
+        }
+        if(simtemp_filter_match(reader, sample))
+        {
+            if(kfifo_put(&reader->sample_fifo, *sample) == 0U)
+            {
+                trace_simtemp_buffer_overrun(simtemp->index, reader, sample->sequence);
+                this_cpu_inc(simtemp->stats->samples_dropped);
+            }
+            else
+            {
+                this_cpu_inc(simtemp->stats->samples_delivered);
+            }
+            reader->wake_pending = true;
+        }
+    }
+    rcu_read_unlock();
+}
+
+
+
+/* @brief Wakes up the readers that got samples queued since the previous call. Called from the timer */
+static void simtemp_readers_wake(struct simtemp_device *simtemp)
+{
+    struct simtemp_reader *reader;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(reader, &simtemp->readers, node)
+    {
+        if(reader->wake_pending)
+        {
+            reader->wake_pending = false;
+            trace_simtemp_reader_wake(simtemp->index, reader, simtemp->sample_sequence - 1U, kfifo_len(&reader->sample_fifo));
+            wake_up(&reader->wait_queue);
+        }
+    }
+    rcu_read_unlock();
+}
+
+
+
+/* @brief Queues a threshold event for every reader and wakes up its POLLPRI waiters. Called from the timer.
+ *        Events are not filtered, and a full queue drops the new event and reports it in the lost field of
+ *        the next one queued.
+ */
+static void simtemp_readers_event(struct simtemp_device *simtemp, const struct simtemp_event *event)
+{
+    struct simtemp_reader *reader;
+    struct simtemp_event reader_event = *event;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(reader, &simtemp->readers, node)
+    {
+        reader_event.lost = reader->events_lost;
+        if(kfifo_put(&reader->event_fifo, reader_event) == 0U)
+        {
+            reader->events_lost++;
+            this_cpu_inc(simtemp->stats->events_dropped);
+            continue;
+        }
+        reader->events_lost = 0U;
+        wake_up(&reader->event_wait_queue);
+    }
+    rcu_read_unlock();
+}
+
+
+
+/* @brief Queues a window summary for every reader in SIMTEMP_FORMAT_SUMMARIES and wakes it up. Called from the timer */
+static void simtemp_readers_summary(struct simtemp_device *simtemp, const struct simtemp_summary *summary)
+{
+    struct simtemp_reader *reader;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(reader, &simtemp->readers, node)
+    {
+        if(READ_ONCE(reader->format) != SIMTEMP_FORMAT_SUMMARIES)
+        {
+            continue;
+        }
+        if(kfifo_put(&reader->summary_fifo, *summary) == 0U)
+        {
+            trace_simtemp_buffer_overrun(simtemp->index, reader, summary->first_sequence);
+            this_cpu_inc(simtemp->stats->summaries_dropped);
+        }
+        wake_up(&reader->wait_queue);
+    }
+    rcu_read_unlock();
+}
+
+
+
+/* @brief Returns true when the fifo of the format selected by the reader has records */
+static bool simtemp_reader_readable(struct simtemp_reader *reader)
+{
+    if(READ_ONCE(reader->format) == SIMTEMP_FORMAT_SUMMARIES)
+    {
+        return !kfifo_is_empty(&reader->summary_fifo);
+    }
+    return !kfifo_is_empty(&reader->sample_fifo);
+}
+
+
+
+/* @brief Evaluates the subscription filter of a reader and updates its decimation and delta state. Called from the
+ *        timer, the only user of that state
+ */
+static bool simtemp_filter_match(struct simtemp_reader *reader, const struct simtemp_sample *sample)
+{
+    struct simtemp_filter filter;
+    __u32 generation;
+    unsigned int seq;
+    bool match = true;
+    __s64 delta;
+
+    do
+    {
+        seq = read_seqbegin(&reader->filter_lock);
+        filter = reader->filter;
+        generation = reader->filter_generation;
+    } while(read_seqretry(&reader->filter_lock, seq));
+
+    /* The first sample after a new filter is delivered, then one every decimation samples */
+    if(reader->filter_state_generation != generation)
+    {
+        reader->filter_state_generation = generation;
+        reader->filter_countdown = 1U;
+        reader->filter_has_last = false;
+    }
+    if(filter.type & SIMTEMP_FILTER_DECIMATE)
+    {
+        reader->filter_countdown--;
+        if(reader->filter_countdown == 0U)
+        {
+            reader->filter_countdown = filter.decimation;
+        }
+        else
+        {
+            match = false;
+        }
+    }
+    if(match && (filter.type & SIMTEMP_FILTER_OUT_OF_BAND))
+    {
+        match = (sample->temp_mC < filter.band_low_mC) || (sample->temp_mC > filter.band_high_mC);
+    }
+    if(match && (filter.type & SIMTEMP_FILTER_DELTA) && reader->filter_has_last)
+    {
+        /* Replayed temperatures can be far apart, the difference of two __s32 needs 33 bits */
+        delta = (__s64)sample->temp_mC - reader->filter_last_mC;
+        match = (abs(delta) > (__s64)filter.delta_mC);
+    }
+    if(match)
+    {
+        reader->filter_has_last = true;
+        reader->filter_last_mC = sample->temp_mC;
+    }
+
+    return match;
+}
+
+
+
+/* @brief Validates and installs a new subscription filter, restarting the decimation count and the delta reference */
+static int simtemp_filter_set(struct simtemp_reader *reader, const struct simtemp_filter *filter)
+{
+    unsigned long irq_flags;
+    unsigned int index;
+
+    if((filter->type & ~SIMTEMP_FILTER_ALL) != 0U)
+    {
+        return -EINVAL;
+    }
+    for(index = 0U; index < ARRAY_SIZE(filter->reserved); index++)
+    {
+        if(filter->reserved[index] != 0U)
+        {
+            return -EINVAL;
+        }
+    }
+    if((filter->type & SIMTEMP_FILTER_DECIMATE) && (filter->decimation == 0U))
+    {
+        return -EINVAL;
+    }
+    if((filter->type & SIMTEMP_FILTER_OUT_OF_BAND) && (filter->band_low_mC > filter->band_high_mC))
+    {
+        return -EINVAL;
+    }
+
+    /* The timer restarts the decimation count and the delta reference when it sees the new generation */
+    write_seqlock_irqsave(&reader->filter_lock, irq_flags);
+    reader->filter = *filter;
+    reader->filter_generation++;
+    write_sequnlock_irqrestore(&reader->filter_lock, irq_flags);
+
+    return 0;
+}
+
+
+
+/* @brief Publishes a sample into the shared ring. Only called from the timer, so there is a single producer.
+ *        The index is taken from the kernel private sequence number, the header fields are only written
+ *        because the consumers can modify the mapping.
+ */
+static void simtemp_ring_publish(struct simtemp_device *simtemp, const struct simtemp_sample *sample)
+{
+    struct simtemp_ring_header *ring = simtemp->ring;
+    struct simtemp_sample *slots = (struct simtemp_sample *)((char *)ring + SIMTEMP_RING_DATA_OFFSET);
+    __u64 head = sample->sequence;
+
+    /* Move the tail before overwriting the oldest slot, a consumer copying that slot checks the tail
+     * after the copy and discards it. Pairs with the acquire fence of the consumer */
+    if(head >= SIMTEMP_RING_CAPACITY)
+    {
+        WRITE_ONCE(ring->tail, head - SIMTEMP_RING_CAPACITY + 1U);
+        smp_wmb();
+    }
+    slots[head & (SIMTEMP_RING_CAPACITY - 1U)] = *sample;
+    /* Make the slot visible before the new head, pairs with the acquire load of the consumer */
+    smp_store_release(&ring->head, head + 1U);
+}
+
+
+
+/* @brief Returns the histogram bucket of a duration in ns, see SIMTEMP_STATS_BUCKETS */
+static unsigned int simtemp_stats_bucket(__u64 ns)
+{
+    unsigned int bucket = fls64(ns);
+
+    if(bucket <= SIMTEMP_STATS_BUCKET0_SHIFT)
+    {
+        return 0U;
+    }
+    bucket = bucket - SIMTEMP_STATS_BUCKET0_SHIFT;
+    return min(bucket, SIMTEMP_STATS_BUCKETS - 1U);
+}
+
+
+
+/* @brief Accounts one timer callback that sampled a device: how late it ran after the programmed expiry and how
+ *        long the sampling took from start to end. Called from the timer, it only updates the copy of this CPU.
+ *        With timer_slack_ns the kernel may run the callback before the hard expiry, that counts as no jitter.
+ */
+static void simtemp_stats_timer(struct simtemp_device *simtemp, ktime_t expires, ktime_t start, ktime_t end)
+{
+    __s64 jitter_ns = ktime_to_ns(ktime_sub(start, expires));
+    __u64 callback_ns = (__u64)ktime_to_ns(ktime_sub(end, start));
+
+    if(jitter_ns < 0)
+    {
+        jitter_ns = 0;
+    }
+    this_cpu_inc(simtemp->stats->timer_expirations);
+    this_cpu_add(simtemp->stats->callback_ns_total, callback_ns);
+    this_cpu_inc(simtemp->stats->callback_histogram[simtemp_stats_bucket(callback_ns)]);
+    this_cpu_inc(simtemp->stats->jitter_histogram[simtemp_stats_bucket((__u64)jitter_ns)]);
+    if(callback_ns > this_cpu_read(simtemp->stats->callback_ns_max))
+    {
+        this_cpu_write(simtemp->stats->callback_ns_max, callback_ns);
+    }
+    if((__u64)jitter_ns > this_cpu_read(simtemp->stats->jitter_ns_max))
+    {
+        this_cpu_write(simtemp->stats->jitter_ns_max, (__u64)jitter_ns);
+    }
+}
+
+
+
+/* @brief Adds up the statistics of every CPU. The timer keeps counting meanwhile, so the fields can be off by the
+ *        callbacks that run during the read
+ */
+static void simtemp_stats_read(struct simtemp_device *simtemp, struct simtemp_stats *stats)
+{
+    const struct simtemp_stats *cpu_stats;
+    unsigned int bucket;
+    int cpu;
+
+    memset(stats, 0, sizeof(*stats));
+    for_each_possible_cpu(cpu)
+    {
+        cpu_stats = per_cpu_ptr(simtemp->stats, cpu);
+        stats->timer_expirations += READ_ONCE(cpu_stats->timer_expirations);
+        stats->timer_overruns += READ_ONCE(cpu_stats->timer_overruns);
+        stats->samples_produced += READ_ONCE(cpu_stats->samples_produced);
+        stats->samples_skipped += READ_ONCE(cpu_stats->samples_skipped);
+        stats->samples_delivered += READ_ONCE(cpu_stats->samples_delivered);
+        stats->samples_dropped += READ_ONCE(cpu_stats->samples_dropped);
+        stats->events += READ_ONCE(cpu_stats->events);
+        stats->events_dropped += READ_ONCE(cpu_stats->events_dropped);
+        stats->summaries += READ_ONCE(cpu_stats->summaries);
+        stats->summaries_dropped += READ_ONCE(cpu_stats->summaries_dropped);
+        stats->callback_ns_total += READ_ONCE(cpu_stats->callback_ns_total);
+        stats->callback_ns_max = max(stats->callback_ns_max, READ_ONCE(cpu_stats->callback_ns_max));
+        stats->jitter_ns_max = max(stats->jitter_ns_max, READ_ONCE(cpu_stats->jitter_ns_max));
+        stats->handoffs_missed += READ_ONCE(cpu_stats->handoffs_missed);
+        for(bucket = 0U; bucket < SIMTEMP_STATS_BUCKETS; bucket++)
+        {
+            stats->callback_histogram[bucket] += READ_ONCE(cpu_stats->callback_histogram[bucket]);
+            stats->jitter_histogram[bucket] += READ_ONCE(cpu_stats->jitter_histogram[bucket]);
+        }
+    }
+    stats->context = READ_ONCE(simtemp->context);
+}
+
+
+
+/* @brief Clears the statistics of every CPU. There is no lock against the timer, a count taken on another CPU while
+ *        its copy is being cleared may survive the reset
+ */
+static void simtemp_stats_reset(struct simtemp_device *simtemp)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        memset(per_cpu_ptr(simtemp->stats, cpu), 0, sizeof(struct simtemp_stats));
+    }
+}
+
+
+
+/* @brief Shows debugfs/simtemp/simtemp_devN/stats: one "name: value" line per counter followed by the histograms,
+ *        one line per bucket with its lower limit in ns and its count
+ */
+static int simtemp_debugfs_stats_show(struct seq_file *m, void *v)
+{
+    struct simtemp_device *simtemp = m->private;
+    struct simtemp_stats stats;
+    unsigned int bucket;
+    __u64 lower_ns;
+
+    simtemp_stats_read(simtemp, &stats);
+    seq_printf(m, "timer_expirations: %llu\n", stats.timer_expirations);
+    seq_printf(m, "timer_overruns: %llu\n", stats.timer_overruns);
+    seq_printf(m, "samples_produced: %llu\n", stats.samples_produced);
+    seq_printf(m, "samples_skipped: %llu\n", stats.samples_skipped);
+    seq_printf(m, "samples_delivered: %llu\n", stats.samples_delivered);
+    seq_printf(m, "samples_dropped: %llu\n", stats.samples_dropped);
+    seq_printf(m, "events: %llu\n", stats.events);
+    seq_printf(m, "events_dropped: %llu\n", stats.events_dropped);
+    seq_printf(m, "summaries: %llu\n", stats.summaries);
+    seq_printf(m, "summaries_dropped: %llu\n", stats.summaries_dropped);
+    seq_printf(m, "callback_ns_total: %llu\n", stats.callback_ns_total);
+    seq_printf(m, "callback_ns_max: %llu\n", stats.callback_ns_max);
+    seq_printf(m, "jitter_ns_max: %llu\n", stats.jitter_ns_max);
+    seq_printf(m, "handoffs_missed: %llu\n", stats.handoffs_missed);
+    seq_printf(m, "context: %s\n", (stats.context == SIMTEMP_CONTEXT_THREAD) ? "thread" :
+                                   (stats.context == SIMTEMP_CONTEXT_SOFTIRQ) ? "softirq" : "hardirq");
+    seq_printf(m, "cpu: %d\n", READ_ONCE(simtemp->cpu));
+    /* Cost of one sample in the selected context, the callback time includes the delivery to every reader */
+    seq_printf(m, "ns_per_sample: %llu\n", (stats.samples_produced == 0U) ? 0ULL :
+                                            div64_u64(stats.callback_ns_total, stats.samples_produced));
+    seq_puts(m, "histogram_lower_ns callback jitter\n");
+    for(bucket = 0U; bucket < SIMTEMP_STATS_BUCKETS; bucket++)
+    {
+        lower_ns = (bucket == 0U) ? 0U : (1ULL << (bucket + SIMTEMP_STATS_BUCKET0_SHIFT - 1U));
+        seq_printf(m, "%llu %llu %llu\n", lower_ns, stats.callback_histogram[bucket], stats.jitter_histogram[bucket]);
+    }
+    return 0;
+}
+
+
+
+/* @brief Ioctl callback function, atomic configuration and state snapshot */
+static long simtemp_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct simtemp_reader *reader = file->private_data;
+    struct simtemp_device *simtemp = reader->simtemp;
+    void __user *user_ptr = (void __user *)arg;
+    struct simtemp_config config;
+    struct simtemp_snapshot snapshot;
+    struct simtemp_filter filter;
+    struct simtemp_filter_chain chain;
+    struct simtemp_waveform waveform;
+    struct simtemp_replay replay;
+    struct simtemp_replay_buffer *buffer;
+    struct simtemp_event event;
+    struct simtemp_stats stats;
+    unsigned long irq_flags;
+    unsigned int nr_events;
+    unsigned int seq;
+    unsigned int publish_seq;
+    __u32 format;
+
+    switch(cmd)
+    {
+        case SIMTEMP_IOC_SET_CONFIG:
+            if(copy_from_user(&config, user_ptr, sizeof(config)) != 0)
+            {
+                return -EFAULT;
+            }
+            return simtemp_config_apply(simtemp, &config);
+
+        case SIMTEMP_IOC_GET_CONFIG:
+            simtemp_config_read(simtemp, &config);
+            if(copy_to_user(user_ptr, &config, sizeof(config)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_GET_SNAPSHOT:
+            memset(&snapshot, 0, sizeof(snapshot));
+            snapshot.version = SIMTEMP_CONFIG_VERSION;
+            /* Retried until neither the configuration nor the latest sample changed during the copy */
+            do
+            {
+                seq = read_seqbegin(&simtemp->config_lock);
+                publish_seq = read_seqcount_begin(&simtemp->publish_seq);
+                snapshot.flags = (__u32)atomic_read(&simtemp->sysfs_flags);
+                snapshot.sample = simtemp->last_sample;
+                simtemp_config_fill(simtemp, &snapshot.config);
+            } while(read_seqcount_retry(&simtemp->publish_seq, publish_seq) || read_seqretry(&simtemp->config_lock, seq));
+            if(copy_to_user(user_ptr, &snapshot, sizeof(snapshot)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_SET_FILTER:
+            if(copy_from_user(&filter, user_ptr, sizeof(filter)) != 0)
+            {
+                return -EFAULT;
+            }
+            return simtemp_filter_set(reader, &filter);
+
+        case SIMTEMP_IOC_GET_FILTER:
+            do
+            {
+                seq = read_seqbegin(&reader->filter_lock);
+                filter = reader->filter;
+            } while(read_seqretry(&reader->filter_lock, seq));
+            if(copy_to_user(user_ptr, &filter, sizeof(filter)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_GET_EVENT:
+            spin_lock_irqsave(&reader->event_lock, irq_flags);
+            nr_events = kfifo_get(&reader->event_fifo, &event);
+            spin_unlock_irqrestore(&reader->event_lock, irq_flags);
+            if(nr_events == 0U)
+            {
+                return -EAGAIN;
+            }
+            if(copy_to_user(user_ptr, &event, sizeof(event)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_SET_FORMAT:
+            if(get_user(format, (__u32 __user *)user_ptr) != 0)
+            {
+                return -EFAULT;
+            }
+            if(format > SIMTEMP_FORMAT_DELTA)
+            {
+                return -EINVAL;
+            }
+            /* The records already queued belong to the previous format, the fifos are drained on the consumer side.
+             * A new delta stream starts with a keyframe */
+            mutex_lock(&reader->read_lock);
+            WRITE_ONCE(reader->format, format);
+            memset(&reader->delta, 0, sizeof(reader->delta));
+            kfifo_reset_out(&reader->sample_fifo);
+            kfifo_reset_out(&reader->summary_fifo);
+            mutex_unlock(&reader->read_lock);
+            return 0;
+
+        case SIMTEMP_IOC_GET_FORMAT:
+            return put_user(READ_ONCE(reader->format), (__u32 __user *)user_ptr);
+
+        case SIMTEMP_IOC_SET_CHAIN:
+            if(copy_from_user(&chain, user_ptr, sizeof(chain)) != 0)
+            {
+                return -EFAULT;
+            }
+            return simtemp_chain_set(simtemp, &chain);
+
+        case SIMTEMP_IOC_GET_CHAIN:
+            simtemp_chain_get(simtemp, &chain);
+            if(copy_to_user(user_ptr, &chain, sizeof(chain)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_SET_WAVEFORM:
+            if(copy_from_user(&waveform, user_ptr, sizeof(waveform)) != 0)
+            {
+                return -EFAULT;
+            }
+            return simtemp_waveform_set(simtemp, &waveform);
+
+        case SIMTEMP_IOC_GET_WAVEFORM:
+            simtemp_waveform_get(simtemp, &waveform);
+            if(copy_to_user(user_ptr, &waveform, sizeof(waveform)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_SET_REPLAY:
+            if(copy_from_user(&replay, user_ptr, sizeof(replay)) != 0)
+            {
+                return -EFAULT;
+            }
+            return simtemp_replay_set(simtemp, &replay);
+
+        case SIMTEMP_IOC_GET_REPLAY:
+            memset(&replay, 0, sizeof(replay));
+            do
+            {
+                seq = read_seqbegin(&simtemp->config_lock);
+                replay.flags = simtemp->replay.flags;
+                replay.speed_q16 = simtemp->replay.speed_q16;
+            } while(read_seqretry(&simtemp->config_lock, seq));
+            rcu_read_lock();
+            buffer = rcu_dereference(simtemp->replay_buffer);
+            replay.count = (buffer != NULL) ? smp_load_acquire(&buffer->count) : 0U;
+            rcu_read_unlock();
+            replay.position = READ_ONCE(simtemp->replay_state.position);
+            if(copy_to_user(user_ptr, &replay, sizeof(replay)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_GET_STATS:
+            simtemp_stats_read(simtemp, &stats);
+            if(copy_to_user(user_ptr, &stats, sizeof(stats)) != 0)
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case SIMTEMP_IOC_RESET_STATS:
+            simtemp_stats_reset(simtemp);
+            return 0;
+
+        default:
+            return -ENOTTY;
+    }
+}
+
+
+
+/* @brief Validates every field selected by the mask and then applies all of them at once.
+ *        Used by SIMTEMP_IOC_SET_CONFIG and by the sysfs store functions.
+ */
+static int simtemp_config_apply(struct simtemp_device *simtemp, const struct simtemp_config *config)
+{
+    unsigned long irq_flags;
+    unsigned int index;
+    __u64 sampling_period;
+
+    if((config->version == 0U) || (config->version > SIMTEMP_CONFIG_VERSION))
+    {
+        return -EINVAL;
+    }
+    if((config->mask & ~SIMTEMP_CFG_ALL) != 0U)
+    {
+        return -EINVAL;
+    }
+    for(index = 0U; index < ARRAY_SIZE(config->reserved); index++)
+    {
+        if(config->reserved[index] != 0U)
+        {
+            return -EINVAL;
+        }
+    }
+    /* The sampling period is given either in ms or in ns */
+    if((config->mask & SIMTEMP_CFG_SAMPLING_TIME) && (config->mask & SIMTEMP_CFG_SAMPLING_PERIOD))
+    {
+        return -EINVAL;
+    }
+    if(config->mask & SIMTEMP_CFG_SAMPLING_TIME)
+    {
+        sampling_period = (__u64)config->sampling_time_ms * NSEC_PER_MSEC;
+    }
+    else
+    {
+        sampling_period = config->sampling_period_ns;
+    }
+    if((config->mask & (SIMTEMP_CFG_SAMPLING_TIME | SIMTEMP_CFG_SAMPLING_PERIOD)) &&
+       ((sampling_period < SIMTEMP_SAMPLING_PERIOD_MIN_NS) || (sampling_period > SIMTEMP_SAMPLING_PERIOD_MAX_NS)))
+    {
+        return -EINVAL;
+    }
+    if((config->mask & SIMTEMP_CFG_MODE) && (config->mode > MODE_REPLAY))
+    {
+        return -EINVAL;
+    }
+    if((config->mask & SIMTEMP_CFG_CLOCK) && (config->clock > SIMTEMP_CLOCK_BOOTTIME))
+    {
+        return -EINVAL;
+    }
+
+    /* Interrupts stay disabled while writing: a timer expiring on this CPU in the middle would retry its copy forever */
+    write_seqlock_irqsave(&simtemp->config_lock, irq_flags);
+    if(config->mask & (SIMTEMP_CFG_SAMPLING_TIME | SIMTEMP_CFG_SAMPLING_PERIOD))
+    {
+        simtemp->sampling_period_ns = sampling_period;
+    }
+    if(config->mask & SIMTEMP_CFG_THRESHOLD)
+    {
+        simtemp->sysfs_temperature_threshold = config->threshold_mC;
+    }
+    if(config->mask & SIMTEMP_CFG_MODE)
+    {
+        simtemp->sysfs_mode = config->mode;
+    }
+    if(config->mask & SIMTEMP_CFG_CLOCK)
+    {
+        simtemp->sysfs_clock = config->clock;
+    }
+    if(config->mask & SIMTEMP_CFG_HYSTERESIS)
+    {
+        simtemp->sysfs_hysteresis = config->hysteresis_mC;
+    }
+    if(config->mask & (SIMTEMP_CFG_WINDOW | SIMTEMP_CFG_WINDOW_SAMPLES))
+    {
+        simtemp->window_samples = config->window_samples;
+    }
+    if(config->mask & (SIMTEMP_CFG_WINDOW | SIMTEMP_CFG_WINDOW_NS))
+    {
+        simtemp->window_ns = config->window_ns;
+    }
+    write_sequnlock_irqrestore(&simtemp->config_lock, irq_flags);
+
+    /* A new sampling time may no longer be a multiple of the group base period, move the device */
+    if((timer_sched == TIMER_SCHED_GROUPED) && (config->mask & (SIMTEMP_CFG_SAMPLING_TIME | SIMTEMP_CFG_SAMPLING_PERIOD)))
+    {
+        mutex_lock(&simtemp_timer_groups_lock);
+        simtemp_timer_group_leave(simtemp);
+        simtemp_timer_group_join(simtemp);
+        mutex_unlock(&simtemp_timer_groups_lock);
+    }
+
+    return 0;
+}
+
+
+
+/* @brief Validates a filter chain and replaces the one of the device, restarting the state of its stages.
+ *        Used by SIMTEMP_IOC_SET_CHAIN and by the sysfs store functions.
+ */
+static int simtemp_chain_set(struct simtemp_device *simtemp, const struct simtemp_filter_chain *chain)
+{
+    unsigned long irq_flags;
+    unsigned int index;
+    __u32 used = 0U;
+
+    for(index = 0U; index < ARRAY_SIZE(chain->reserved); index++)
+    {
+        if(chain->reserved[index] != 0U)
+        {
+            return -EINVAL;
+        }
+    }
+    /* Every stage type keeps a single state, so it can appear only once */
+    for(index = 0U; index < SIMTEMP_CHAIN_MAX_STAGES; index++)
+    {
+        if(chain->stages[index] > SIMTEMP_CHAIN_MEDIAN)
+        {
+            return -EINVAL;
+        }
+        if(chain->stages[index] == SIMTEMP_CHAIN_NONE)
+        {
+            continue;
+        }
+        if(used & (1U << chain->stages[index]))
+        {
+            return -EINVAL;
+        }
+        used = used | (1U << chain->stages[index]);
+    }
+    if((chain->ema_alpha_q16 == 0U) || (chain->ema_alpha_q16 > SIMTEMP_CHAIN_ALPHA_ONE))
+    {
+        return -EINVAL;
+    }
+    if((chain->average_window == 0U) || (chain->average_window > SIMTEMP_CHAIN_MAX_AVERAGE_WINDOW))
+    {
+        return -EINVAL;
+    }
+    if((chain->median_window == 0U) || (chain->median_window > SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW))
+    {
+        return -EINVAL;
+    }
+
+    write_seqlock_irqsave(&simtemp->config_lock, irq_flags);
+    simtemp->chain = *chain;
+    simtemp->chain_generation++;
+    write_sequnlock_irqrestore(&simtemp->config_lock, irq_flags);
+    return 0;
+}
+
+
+
+/* @brief Validates a waveform and replaces the one of the device, the timer restarts the generator before the
+ *        next sample. Used by SIMTEMP_IOC_SET_WAVEFORM and by simtemp_sysfs_seed.
+ */
+static int simtemp_waveform_set(struct simtemp_device *simtemp, const struct simtemp_waveform *waveform)
+{
+    unsigned long irq_flags;
+    unsigned int index;
+
+    for(index = 0U; index < ARRAY_SIZE(waveform->reserved); index++)
+    {
+        if(waveform->reserved[index] != 0U)
+        {
+            return -EINVAL;
+        }
+    }
+    if((waveform->period_ns < SIMTEMP_WAVEFORM_PERIOD_MIN_NS) || (waveform->period_ns > SIMTEMP_WAVEFORM_PERIOD_MAX_NS))
+    {
+        return -EINVAL;
+    }
+    if((waveform->amplitude_mC > SIMTEMP_WAVEFORM_MAX_MC) || (waveform->noise_mC > SIMTEMP_WAVEFORM_MAX_MC))
+    {
+        return -EINVAL;
+    }
+    if((waveform->ramp_low_mC >= waveform->ramp_high_mC) || (waveform->ramp_step_mC == 0U) ||
+       (waveform->ramp_step_mC > SIMTEMP_WAVEFORM_MAX_MC))
+    {
+        return -EINVAL;
+    }
+
+    write_seqlock_irqsave(&simtemp->config_lock, irq_flags);
+    simtemp->waveform = *waveform;
+    simtemp->waveform_generation++;
+    write_sequnlock_irqrestore(&simtemp->config_lock, irq_flags);
+    return 0;
+}
+
+
+
+/* @brief Installs the playback control of MODE_REPLAY and restarts the playback, discarding the loaded records
+ *        first with SIMTEMP_REPLAY_CLEAR. Used by SIMTEMP_IOC_SET_REPLAY.
+ */
+static int simtemp_replay_set(struct simtemp_device *simtemp, const struct simtemp_replay *replay)
+{
+    struct simtemp_replay_buffer *buffer;
+    unsigned long irq_flags;
+    unsigned int index;
+
+    for(index = 0U; index < ARRAY_SIZE(replay->reserved); index++)
+    {
+        if(replay->reserved[index] != 0U)
+        {
+            return -EINVAL;
+        }
+    }
+    if(((replay->flags & ~(SIMTEMP_REPLAY_LOOP | SIMTEMP_REPLAY_ORIGINAL_RATE | SIMTEMP_REPLAY_CLEAR)) != 0U) ||
+       (replay->speed_q16 == 0U))
+    {
+        return -EINVAL;
+    }
+
+    if(replay->flags & SIMTEMP_REPLAY_CLEAR)
+    {
+        mutex_lock(&simtemp->replay_lock);
+        buffer = rcu_dereference_protected(simtemp->replay_buffer, lockdep_is_held(&simtemp->replay_lock));
+        RCU_INIT_POINTER(simtemp->replay_buffer, NULL);
+        mutex_unlock(&simtemp->replay_lock);
+        /* Wait for the timer to stop using the records */
+        synchronize_rcu();
+        kvfree(buffer);
+    }
+
+    write_seqlock_irqsave(&simtemp->config_lock, irq_flags);
+    simtemp->replay.flags = replay->flags & ~SIMTEMP_REPLAY_CLEAR;
+    simtemp->replay.speed_q16 = replay->speed_q16;
+    simtemp->replay_generation++;
+    write_sequnlock_irqrestore(&simtemp->config_lock, irq_flags);
+    return 0;
+}
+
+
+
+/* @brief Fills a struct simtemp_config with the configuration in effect. Caller holds simtemp->config_lock or is
+ *        inside a read section of it
+ */
+static void simtemp_config_fill(struct simtemp_device *simtemp, struct simtemp_config *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->version = SIMTEMP_CONFIG_VERSION;
+    /* sampling_period_ns is exact, the mask can be passed back to SIMTEMP_IOC_SET_CONFIG as it is */
+    config->mask = SIMTEMP_CFG_ALL & ~SIMTEMP_CFG_SAMPLING_TIME;
+    config->sampling_time_ms = (__u32)div_u64(simtemp->sampling_period_ns, NSEC_PER_MSEC);
+    config->sampling_period_ns = simtemp->sampling_period_ns;
+    config->threshold_mC = simtemp->sysfs_temperature_threshold;
+    config->mode = simtemp->sysfs_mode;
+    config->clock = simtemp->sysfs_clock;
+    config->hysteresis_mC = simtemp->sysfs_hysteresis;
+    config->window_samples = simtemp->window_samples;
+    config->window_ns = simtemp->window_ns;
+}
+
+
+
+/* @brief Copies the configuration in effect without taking simtemp->config_lock, retrying while it changes */
+static void simtemp_config_read(struct simtemp_device *simtemp, struct simtemp_config *config)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = read_seqbegin(&simtemp->config_lock);
+        simtemp_config_fill(simtemp, config);
+    } while(read_seqretry(&simtemp->config_lock, seq));
+}
+
+
+
+/* @brief Copies the filter chain in effect without taking simtemp->config_lock */
+static void simtemp_chain_get(struct simtemp_device *simtemp, struct simtemp_filter_chain *chain)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = read_seqbegin(&simtemp->config_lock);
+        *chain = simtemp->chain;
+    } while(read_seqretry(&simtemp->config_lock, seq));
+}
+
+
+
+/* @brief Copies the waveform in effect without taking simtemp->config_lock */
+static void simtemp_waveform_get(struct simtemp_device *simtemp, struct simtemp_waveform *waveform)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = read_seqbegin(&simtemp->config_lock);
+        *waveform = simtemp->waveform;
+    } while(read_seqretry(&simtemp->config_lock, seq));
+}
+
+
+
+/* @brief Copies the latest sample published by the timer and the clock of its timestamp, never torn */
+static void simtemp_last_sample_get(struct simtemp_device *simtemp, struct simtemp_sample *sample, __u32 *clock)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = read_seqcount_begin(&simtemp->publish_seq);
+        *sample = simtemp->last_sample;
+        *clock = simtemp->last_sample_clock;
+    } while(read_seqcount_retry(&simtemp->publish_seq, seq));
+}
+
+
+
+/* @brief Copies the latest summary published by the timer, never torn */
+static void simtemp_last_summary_get(struct simtemp_device *simtemp, struct simtemp_summary *summary)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = read_seqcount_begin(&simtemp->publish_seq);
+        *summary = simtemp->last_summary;
+    } while(read_seqcount_retry(&simtemp->publish_seq, seq));
+}
+
+
+
+/* @brief This function simulates the process to obtain temperature samples. Called from the timer, it only
+ *        uses the state of the generator and integer arithmetic, so it costs a few tens of ns whatever the mode.
+ */
+static __s32 simtemp_get_temperature(struct simtemp_device *simtemp, __u32 mode, const struct simtemp_waveform *waveform)
+{
+    struct simtemp_waveform_state *state = &simtemp->waveform_state;
+    __s64 temperature = waveform->offset_mC;
+    __s64 sine;
+    __u32 index;
+    __u32 fraction;
+    __s32 replayed;
+
+    /* Ramp the temperature up until ramp_high_mC is reached, then ramp it down until ramp_low_mC is reached */
+    if(mode == MODE_RAMP)
+    {
+        if(state->ramp_mC >= waveform->ramp_high_mC)
+        {
+            state->ramp_rising = false;
+        }
+        else if(state->ramp_mC <= waveform->ramp_low_mC)
+        {
+            state->ramp_rising = true;
+        }
+        else
+        {
+            /* Do Nothing */
+        }
+
+        if(state->ramp_rising == true)
+        {
+            state->ramp_mC = (__s32)min_t(__s64, (__s64)state->ramp_mC + waveform->ramp_step_mC, waveform->ramp_high_mC);
+        }
+        else
+        {
+            state->ramp_mC = (__s32)max_t(__s64, (__s64)state->ramp_mC - waveform->ramp_step_mC, waveform->ramp_low_mC);
+        }
+        temperature = state->ramp_mC;
+    }
+    /* Linear interpolation between two entries of the Q15 sine table */
+    else if(mode == MODE_SINE)
+    {
+        index = state->phase >> 24;
+        fraction = (state->phase >> 8) & 0xFFFFU;
+        sine = simtemp_sine_table[index];
+        sine = sine + (((simtemp_sine_table[(index + 1U) & (SIMTEMP_SINE_TABLE_SIZE - 1U)] - sine) * fraction) >> 16);
+        temperature = temperature + ((sine * waveform->amplitude_mC) >> 15);
+        state->phase = state->phase + state->phase_step;
+    }
+    else if(mode == MODE_SQUARE)
+    {
+        if(state->phase < 0x80000000U)
+        {
+            temperature = temperature + waveform->amplitude_mC;
+        }
+        else
+        {
+            temperature = temperature - waveform->amplitude_mC;
+        }
+        state->phase = state->phase + state->phase_step;
+    }
+    else if(mode == MODE_NOISY)
+    {
+        temperature = temperature + simtemp_prng_gaussian(state, waveform->amplitude_mC);
+    }
+    else if(mode == MODE_REPLAY)
+    {
+        /* Nothing loaded yet, report the offset */
+        if(simtemp_replay_next(simtemp, &replayed))
+        {
+            temperature = replayed;
+        }
+    }
+    else
+    {
+        /* A stable temperature reading will be returned */
+    }
+
+    /* Noise layered on top of every mode */
+    if(waveform->noise_mC != 0U)
+    {
+        temperature = temperature + simtemp_prng_gaussian(state, waveform->noise_mC);
+    }
+
+    simtemp->temperature_sensor_reading = (__s32)clamp_t(__s64, temperature, S32_MIN, S32_MAX);
+    return simtemp->temperature_sensor_reading;
+}
+
+
+
+/* @brief Restarts the waveform generator: seeds the PRNG, rewinds the phase and starts the ramp at the offset */
+static void simtemp_waveform_restart(struct simtemp_device *simtemp, const struct simtemp_waveform *waveform)
+{
+    struct simtemp_waveform_state *state = &simtemp->waveform_state;
+    __u64 seed = waveform->seed;
+
+    /* splitmix64 spreads similar seeds (device N and N + 1) into unrelated xorshift states */
+    seed = seed + 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    seed = seed ^ (seed >> 31);
+    state->prng = (seed != 0U) ? seed : DEFAULT_WAVEFORM_SEED;
+    state->phase = 0U;
+    state->ramp_mC = clamp_t(__s32, waveform->offset_mC, waveform->ramp_low_mC, waveform->ramp_high_mC);
+    state->ramp_rising = true;
+}
+
+
+
+/* @brief Approximately Gaussian value with a mean of 0 and a standard deviation of sigma_mC. The sum of the four
+ *        uniform 16-bit values of one PRNG draw has a standard deviation of 65536 / sqrt(3), it is scaled with
+ *        3547 / 2^27 ~= sqrt(3) / 65536. The tails are cut at about 3.5 sigma.
+ */
+static __s32 simtemp_prng_gaussian(struct simtemp_waveform_state *state, __u32 sigma_mC)
+{
+    __u64 random_value = simtemp_prng_next(state);
+    __s64 sum;
+
+    sum = (__s64)(random_value & 0xFFFFU) + (__s64)((random_value >> 16) & 0xFFFFU) +
+          (__s64)((random_value >> 32) & 0xFFFFU) + (__s64)(random_value >> 48) - 131070;
+    return (__s32)((sum * sigma_mC * 3547) >> 27);
+}
+
+
+
+/* @brief Returns the next record of the replay trace and advances the playback. After the last record the playback
+ *        starts over with SIMTEMP_REPLAY_LOOP and keeps returning the last record otherwise.
+ *        Returns false when no record is loaded. Called from the timer.
+ */
+static bool simtemp_replay_next(struct simtemp_device *simtemp, __s32 *temperature)
+{
+    struct simtemp_replay_state *state = &simtemp->replay_state;
+    struct simtemp_replay_buffer *buffer;
+    __u32 count;
+    bool found = false;
+
+    rcu_read_lock();
+    buffer = rcu_dereference(simtemp->replay_buffer);
+    count = (buffer != NULL) ? smp_load_acquire(&buffer->count) : 0U;
+    if(count != 0U)
+    {
+        if(state->position >= count)
+        {
+            state->position = (state->flags & SIMTEMP_REPLAY_LOOP) ? 0U : (count - 1U);
+        }
+        *temperature = buffer->records[state->position].temp_mC;
+        WRITE_ONCE(state->position, state->position + 1U);
+        found = true;
+    }
+    rcu_read_unlock();
+    return found;
+}
+
+
+
+/* @brief xorshift64*, a handful of shifts and one multiplication per 64 random bits */
+static __u64 simtemp_prng_next(struct simtemp_waveform_state *state)
+{
+    __u64 x = state->prng;
+
+    x = x ^ (x >> 12);
+    x = x ^ (x << 25);
+    x = x ^ (x >> 27);
+    state->prng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+
+/* @brief This function returns the current time in ns of the given SIMTEMP_CLOCK_* clock */
+static __u64 simtemp_get_timestamp(__u32 clock)
+{
+    switch(clock)
+    {
+        case SIMTEMP_CLOCK_REALTIME:
+            return ktime_get_real_ns();
+        case SIMTEMP_CLOCK_BOOTTIME:
+            return ktime_get_boottime_ns();
+        default:
+            return ktime_get_ns();
+    }
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_sampling_time */
+static ssize_t simtemp_sysfs_sampling_time_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%llu", div_u64(config.sampling_period_ns, NSEC_PER_MSEC));
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_sampling_time */
+static ssize_t simtemp_sysfs_sampling_time_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_SAMPLING_TIME };
+    int ret_value;
+
+    if(sscanf(buf, "%u", &config.sampling_time_ms) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_sampling_period_ns */
+static ssize_t simtemp_sysfs_sampling_period_ns_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%llu", config.sampling_period_ns);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_sampling_period_ns */
+static ssize_t simtemp_sysfs_sampling_period_ns_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_SAMPLING_PERIOD };
+    int ret_value;
+
+    if(sscanf(buf, "%llu", &config.sampling_period_ns) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_temperature_threshold */
+static ssize_t simtemp_sysfs_temperature_threshold_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%d", config.threshold_mC);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_temperature_threshold */
+static ssize_t simtemp_sysfs_temperature_threshold_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_THRESHOLD };
+    int ret_value;
+
+    if(sscanf(buf, "%d", &config.threshold_mC) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_hysteresis */
+static ssize_t simtemp_sysfs_hysteresis_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%u", config.hysteresis_mC);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_hysteresis */
+static ssize_t simtemp_sysfs_hysteresis_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_HYSTERESIS };
+    int ret_value;
+
+    if(sscanf(buf, "%u", &config.hysteresis_mC) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the timestamp of the latest sample as wall clock time.
+ *        The string is only built here, the timer callback just stores the raw ns value.
+ */
+static ssize_t simtemp_sysfs_timestamp_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_sample sample;
+    struct rtc_time tm;
+    __u64 timestamp_ns;
+    __u32 clock;
+    __u32 remainder_ns;
+    __u64 seconds;
+
+    simtemp_last_sample_get(simtemp, &sample, &clock);
+    timestamp_ns = sample.timestamp_ns;
+    /* No sample has been taken yet */
+    if(timestamp_ns == 0U)
+    {
+        return 0;
+    }
+    /* Move monotonic and boottime stamps to the real time clock using the current offset between both clocks */
+    if(clock != SIMTEMP_CLOCK_REALTIME)
+    {
+        timestamp_ns = timestamp_ns + (ktime_get_real_ns() - simtemp_get_timestamp(clock));
+    }
+    seconds = div_u64_rem(timestamp_ns, NSEC_PER_SEC, &remainder_ns);
+    rtc_time64_to_tm(seconds, &tm);
+    return sprintf(buf, "%d-%d-%d, T%d:%d:%d:%03u", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                   remainder_ns / (__u32)NSEC_PER_MSEC);
+}
+
+
+
+/* @brief Show function for reading the temperature of the latest sample, read-only since only the timer produces it */
+static ssize_t simtemp_sysfs_temp_mc_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_sample sample;
+    __u32 clock;
+
+    simtemp_last_sample_get(simtemp, &sample, &clock);
+    return sprintf(buf, "%d", sample.temp_mC);
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_flags */
+static ssize_t simtemp_sysfs_flags_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    return sprintf(buf, "%u", (__u32)atomic_read(&simtemp->sysfs_flags));
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_flags */
+static ssize_t simtemp_sysfs_flags_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    __u32 flags;
+
+    if(sscanf(buf, "%u", &flags) != 1)
+    {
+        return -EINVAL;
+    }
+    atomic_set(&simtemp->sysfs_flags, flags);
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_mode */
+static ssize_t simtemp_sysfs_mode_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%u", config.mode);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_mode */
+static ssize_t simtemp_sysfs_mode_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_MODE };
+    int ret_value;
+
+    if(sscanf(buf, "%u", &config.mode) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_clock */
+static ssize_t simtemp_sysfs_clock_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%u", config.clock);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_clock */
+static ssize_t simtemp_sysfs_clock_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_CLOCK };
+    int ret_value;
+
+    if(sscanf(buf, "%u", &config.clock) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the execution context of the sampling, SIMTEMP_CONTEXT_* */
+static ssize_t simtemp_sysfs_context_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    return sprintf(buf, "%u", READ_ONCE(simtemp->context));
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_context, moves the sampling to that context */
+static ssize_t simtemp_sysfs_context_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    __u32 context;
+    int ret_value;
+
+    if(sscanf(buf, "%u", &context) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_context_set(simtemp, context);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the CPU the sampling is pinned to, -1 when it is not pinned */
+static ssize_t simtemp_sysfs_cpu_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    return sprintf(buf, "%d", READ_ONCE(simtemp->cpu));
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_cpu, pins the timer and the thread of the device
+ *        to that CPU and allocates the buffers of the files opened from then on in its node. -1 unpins them.
+ */
+static ssize_t simtemp_sysfs_cpu_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    int cpu;
+    int ret_value;
+
+    if(sscanf(buf, "%d", &cpu) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_cpu_set(simtemp, cpu);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_window_samples */
+static ssize_t simtemp_sysfs_window_samples_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%u", config.window_samples);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_window_samples */
+static ssize_t simtemp_sysfs_window_samples_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_WINDOW_SAMPLES };
+    int ret_value;
+
+    if(sscanf(buf, "%u", &config.window_samples) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_window_ns */
+static ssize_t simtemp_sysfs_window_ns_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config;
+
+    simtemp_config_read(simtemp, &config);
+    return sprintf(buf, "%llu", config.window_ns);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_window_ns */
+static ssize_t simtemp_sysfs_window_ns_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_config config = { .version = SIMTEMP_CONFIG_VERSION, .mask = SIMTEMP_CFG_WINDOW_NS };
+    int ret_value;
+
+    if(sscanf(buf, "%llu", &config.window_ns) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_config_apply(simtemp, &config);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the latest completed aggregation window */
+static ssize_t simtemp_sysfs_summary_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_summary summary;
+
+    simtemp_last_summary_get(simtemp, &summary);
+    return sprintf(buf, "count=%u min=%d max=%d mean=%d first_seq=%llu first_ns=%llu last_ns=%llu", summary.count,
+                   summary.min_mC, summary.max_mC, summary.mean_mC, summary.first_sequence, summary.first_timestamp_ns,
+                   summary.last_timestamp_ns);
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_seed */
+static ssize_t simtemp_sysfs_seed_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_waveform waveform;
+
+    simtemp_waveform_get(simtemp, &waveform);
+    return sprintf(buf, "%llu", waveform.seed);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_seed, restarts the waveform generator */
+static ssize_t simtemp_sysfs_seed_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_waveform waveform;
+    int ret_value;
+
+    simtemp_waveform_get(simtemp, &waveform);
+    if(sscanf(buf, "%llu", &waveform.seed) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_waveform_set(simtemp, &waveform);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the stages of the filter chain, SIMTEMP_CHAIN_* in processing order */
+static ssize_t simtemp_sysfs_filter_chain_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+
+    simtemp_chain_get(simtemp, &chain);
+    return sprintf(buf, "%u %u %u %u", chain.stages[0], chain.stages[1], chain.stages[2], chain.stages[3]);
+}
+
+
+
+/* @brief Define the store function for writing the stages of the filter chain, up to four SIMTEMP_CHAIN_* values.
+ *        The missing ones are SIMTEMP_CHAIN_NONE, so writing 0 disables the chain.
+ */
+static ssize_t simtemp_sysfs_filter_chain_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+    int ret_value;
+
+    simtemp_chain_get(simtemp, &chain);
+    memset(chain.stages, 0, sizeof(chain.stages));
+    if(sscanf(buf, "%u %u %u %u", &chain.stages[0], &chain.stages[1], &chain.stages[2], &chain.stages[3]) < 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_chain_set(simtemp, &chain);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_filter_ema_alpha */
+static ssize_t simtemp_sysfs_filter_ema_alpha_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+
+    simtemp_chain_get(simtemp, &chain);
+    return sprintf(buf, "%u", chain.ema_alpha_q16);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_filter_ema_alpha, Q16 */
+static ssize_t simtemp_sysfs_filter_ema_alpha_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+    int ret_value;
+
+    simtemp_chain_get(simtemp, &chain);
+    if(sscanf(buf, "%u", &chain.ema_alpha_q16) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_chain_set(simtemp, &chain);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_filter_average_window */
+static ssize_t simtemp_sysfs_filter_average_window_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+
+    simtemp_chain_get(simtemp, &chain);
+    return sprintf(buf, "%u", chain.average_window);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_filter_average_window */
+static ssize_t simtemp_sysfs_filter_average_window_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+    int ret_value;
+
+    simtemp_chain_get(simtemp, &chain);
+    if(sscanf(buf, "%u", &chain.average_window) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_chain_set(simtemp, &chain);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Show function for reading the contents of simtemp_sysfs_filter_median_window */
+static ssize_t simtemp_sysfs_filter_median_window_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+
+    simtemp_chain_get(simtemp, &chain);
+    return sprintf(buf, "%u", chain.median_window);
+}
+
+
+
+/* @brief Define the store function for writing to simtemp_sysfs_filter_median_window */
+static ssize_t simtemp_sysfs_filter_median_window_store(struct device *d, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct simtemp_device *simtemp = dev_get_drvdata(d);
+    struct simtemp_filter_chain chain;
+    int ret_value;
+
+    simtemp_chain_get(simtemp, &chain);
+    if(sscanf(buf, "%u", &chain.median_window) != 1)
+    {
+        return -EINVAL;
+    }
+    ret_value = simtemp_chain_set(simtemp, &chain);
+    if(ret_value != 0)
+    {
+        return ret_value;
+    }
+    return count;
+}
+
+
+
+/* @brief Adds up the sampling timer expirations counted by every CPU */
+static __u64 simtemp_timer_expirations_read(void)
+{
+    __u64 expirations = 0U;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        expirations += READ_ONCE(per_cpu(simtemp_timer_expirations, cpu));
+    }
+    return expirations;
+}
+
+
+
+/* @brief Show function for the total number of sampling timer expirations */
+static ssize_t simtemp_timer_expirations_show(const struct class *c, const struct class_attribute *attr, char *buf)
+{
+    return sprintf(buf, "%llu", simtemp_timer_expirations_read());
+}
+
+
+
+/* @brief Show function for the sampling timer expirations per second, averaged since the previous read */
+static ssize_t simtemp_timer_expirations_per_sec_show(const struct class *c, const struct class_attribute *attr, char *buf)
+{
+    __u64 expirations;
+    __u64 now_ns;
+    __u64 rate;
+
+    mutex_lock(&simtemp_rate_lock);
+    expirations = simtemp_timer_expirations_read();
+    now_ns = ktime_get_ns();
+    rate = 0U;
+    if(now_ns > simtemp_rate_last_time_ns)
+    {
+        rate = div64_u64((expirations - simtemp_rate_last_expirations) * NSEC_PER_SEC, now_ns - simtemp_rate_last_time_ns);
+    }
+    simtemp_rate_last_expirations = expirations;
+    simtemp_rate_last_time_ns = now_ns;
+    mutex_unlock(&simtemp_rate_lock);
+
+    return sprintf(buf, "%llu", rate);
 }
 
 
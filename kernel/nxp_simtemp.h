@@ -0,0 +1,374 @@
+/**
+ * @file nxp_simtemp.h
+ * @brief Interface shared between the simtemp kernel module and the user space applications.
+ *        Everything defined here is part of the binary interface exposed by /dev/simtemp_devN.
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+#ifndef NXP_SIMTEMP_H
+#define NXP_SIMTEMP_H
+
+/******************/
+/**** Includes ****/
+/******************/
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+
+
+/****************************/
+/**** Macro definitions *****/
+/****************************/
+/* Bits reported in the flags field of every sample and in simtemp_sysfs_flags */
+#define SIMTEMP_FLAG_NEW_SAMPLE          0x1U
+#define SIMTEMP_FLAG_THRESHOLD_CROSSED   0x2U /* Alarm active: set above threshold_mC, cleared below threshold_mC - hysteresis_mC */
+
+/* Values of simtemp_event.type */
+#define SIMTEMP_EVENT_RISING             1U /* The temperature went above threshold_mC */
+#define SIMTEMP_EVENT_FALLING            2U /* The temperature went below threshold_mC - hysteresis_mC */
+
+/* Values found in the header of the shared sample ring returned by mmap() */
+#define SIMTEMP_RING_MAGIC               0x53494D54U /* "SIMT" */
+#define SIMTEMP_RING_VERSION             1U
+
+/* Sampling modes */
+#define SIMTEMP_MODE_NORMAL              0U
+#define SIMTEMP_MODE_NOISY               1U
+#define SIMTEMP_MODE_RAMP                2U
+#define SIMTEMP_MODE_SINE                3U
+#define SIMTEMP_MODE_SQUARE              4U
+#define SIMTEMP_MODE_REPLAY              5U /* Plays back the records written to the device, see struct simtemp_replay */
+
+/* Replay of a recorded trace */
+#define SIMTEMP_REPLAY_LOOP              0x1U /* Start over after the last record instead of holding it */
+#define SIMTEMP_REPLAY_ORIGINAL_RATE     0x2U /* Emit every record after its delta_ns instead of one per sampling period */
+#define SIMTEMP_REPLAY_CLEAR             0x4U /* SIMTEMP_IOC_SET_REPLAY only: discard the records loaded so far */
+#define SIMTEMP_REPLAY_MAX_RECORDS       65536U /* Records a device can hold */
+#define SIMTEMP_REPLAY_SPEED_ONE         65536U /* speed_q16 is a Q16 fixed-point value, this is 1x */
+
+/* Limits of struct simtemp_waveform */
+#define SIMTEMP_WAVEFORM_PERIOD_MIN_NS   1000ULL
+#define SIMTEMP_WAVEFORM_PERIOD_MAX_NS   3600000000000ULL
+#define SIMTEMP_WAVEFORM_MAX_MC          1000000U /* Largest amplitude_mC, ramp_step_mC and noise_mC */
+
+/* Clocks that can be used for the sample timestamps */
+#define SIMTEMP_CLOCK_MONOTONIC          0U
+#define SIMTEMP_CLOCK_REALTIME           1U
+#define SIMTEMP_CLOCK_BOOTTIME           2U
+
+/* Execution context in which a device takes its samples, selected per device with simtemp_sysfs_context */
+#define SIMTEMP_CONTEXT_HARDIRQ          0U /* In the hrtimer callback, hard interrupt context (default) */
+#define SIMTEMP_CONTEXT_SOFTIRQ          1U /* In the hrtimer callback run as a softirq (HRTIMER_MODE_REL_SOFT) */
+#define SIMTEMP_CONTEXT_THREAD           2U /* In a real time kthread of the device, the hrtimer callback only wakes it */
+
+/* Record formats returned by read(), selected per open file with SIMTEMP_IOC_SET_FORMAT */
+#define SIMTEMP_FORMAT_SAMPLES           0U /* struct simtemp_sample, default */
+#define SIMTEMP_FORMAT_SUMMARIES         1U /* struct simtemp_summary, one per completed aggregation window */
+#define SIMTEMP_FORMAT_DELTA             2U /* Samples compressed as a keyframe followed by delta records, see below */
+
+/* SIMTEMP_FORMAT_DELTA byte stream. Every read() returns whole records and the decoder keeps its state from one
+ * read() to the next. Varints are LEB128: 7 bits per byte, least significant group first, bit 7 set on every byte
+ * but the last. Signed values are zig-zag encoded before, (v << 1) ^ (v >> 63), so small magnitudes stay short.
+ *
+ * Keyframe, first byte SIMTEMP_DELTA_KEYFRAME:
+ *     varint sequence, varint timestamp_ns, zig-zag varint temp_mC, varint flags.
+ *     Both predicted deltas below restart at 0.
+ * Delta record, first byte 0 X TTTTTT:
+ *     X (SIMTEMP_DELTA_EXTENDED): an extension byte of SIMTEMP_DELTA_EXT_* bits follows, then one varint per bit
+ *     set in bit order: flags, samples lost before this one, zig-zag timestamp error.
+ *     TTTTTT: zig-zag temperature error. SIMTEMP_DELTA_TEMP_ESCAPE means that the error follows as a zig-zag varint,
+ *     after the extension fields.
+ *     Decoding, with the 64-bit wrapping arithmetic of the fields and the previous sample as reference:
+ *         sequence        = previous sequence + 1 + lost
+ *         timestamp_delta = previous timestamp_delta + timestamp error, timestamp_ns = previous + timestamp_delta
+ *         temp_delta      = previous temp_delta + temperature error,    temp_mC      = previous + temp_delta
+ *         flags           = previous flags unless SIMTEMP_DELTA_EXT_FLAGS
+ * The timestamp and the temperature are predicted to keep their previous step: samples exactly one period apart
+ * (high-rate mode) with a constant temperature or a ramp cost one byte each, timer jitter in the timestamps of
+ * the other periods adds a few bytes. A keyframe starts the stream and every
+ * SIMTEMP_DELTA_KEYFRAME_INTERVAL samples, so a capture can be decoded from any keyframe. */
+#define SIMTEMP_DELTA_KEYFRAME           0x80U
+#define SIMTEMP_DELTA_EXTENDED           0x40U
+#define SIMTEMP_DELTA_TEMP_MASK          0x3FU
+#define SIMTEMP_DELTA_TEMP_ESCAPE        0x3FU
+#define SIMTEMP_DELTA_EXT_FLAGS          0x1U
+#define SIMTEMP_DELTA_EXT_LOST           0x2U
+#define SIMTEMP_DELTA_EXT_TIMESTAMP      0x4U
+#define SIMTEMP_DELTA_KEYFRAME_INTERVAL  1024U
+#define SIMTEMP_DELTA_RECORD_MAX         32U /* Longest record, read() needs a buffer of at least this size */
+
+/* Stages of the filter chain applied to every sample before it is published */
+#define SIMTEMP_CHAIN_NONE               0U /* Empty slot */
+#define SIMTEMP_CHAIN_EMA                1U /* Exponential moving average, y += alpha * (x - y) */
+#define SIMTEMP_CHAIN_MOVING_AVERAGE     2U /* Mean of the last average_window inputs */
+#define SIMTEMP_CHAIN_MEDIAN             3U /* Median of the last median_window inputs */
+#define SIMTEMP_CHAIN_MAX_STAGES         4U
+#define SIMTEMP_CHAIN_MAX_AVERAGE_WINDOW 64U
+#define SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW  15U
+#define SIMTEMP_CHAIN_ALPHA_ONE          65536U /* ema_alpha_q16 is a Q16 fixed-point value, this is 1.0 */
+
+/* Histograms of struct simtemp_stats, log2 buckets of ns: bucket 0 counts the values below 1024 ns, bucket N
+ * the values from 2^(N+9) to 2^(N+10) - 1 ns and the last bucket everything from 2^(N+9) ns up (about 16.8 ms) */
+#define SIMTEMP_STATS_BUCKETS            16U
+#define SIMTEMP_STATS_BUCKET0_SHIFT      10U
+
+/* Limits of the sampling period */
+#define SIMTEMP_SAMPLING_PERIOD_MIN_NS   10000ULL         /* 100 kHz */
+#define SIMTEMP_SAMPLING_PERIOD_MAX_NS   3600000000000ULL /* 1 hour */
+
+/* Version of struct simtemp_config and struct simtemp_snapshot understood by this driver.
+ * Version 2 added the clock field, version 3 the sampling_period_ns field, version 4 the hysteresis_mC field
+ * version 5 the window_samples and window_ns fields and version 6 the SIMTEMP_CFG_WINDOW_SAMPLES and
+ * SIMTEMP_CFG_WINDOW_NS bits. */
+#define SIMTEMP_CONFIG_VERSION           6U
+
+/* Bits of simtemp_config.mask selecting the fields applied by SIMTEMP_IOC_SET_CONFIG */
+#define SIMTEMP_CFG_SAMPLING_TIME        0x1U
+#define SIMTEMP_CFG_THRESHOLD            0x2U
+#define SIMTEMP_CFG_MODE                 0x4U
+#define SIMTEMP_CFG_CLOCK                0x8U
+#define SIMTEMP_CFG_SAMPLING_PERIOD      0x10U /* Mutually exclusive with SIMTEMP_CFG_SAMPLING_TIME */
+#define SIMTEMP_CFG_HYSTERESIS           0x20U
+#define SIMTEMP_CFG_WINDOW               0x40U /* window_samples and window_ns */
+#define SIMTEMP_CFG_WINDOW_SAMPLES       0x80U /* window_samples only, the other limit is kept */
+#define SIMTEMP_CFG_WINDOW_NS            0x100U /* window_ns only, the other limit is kept */
+#define SIMTEMP_CFG_ALL                  (SIMTEMP_CFG_SAMPLING_TIME | SIMTEMP_CFG_THRESHOLD | SIMTEMP_CFG_MODE | SIMTEMP_CFG_CLOCK | \
+                                          SIMTEMP_CFG_SAMPLING_PERIOD | SIMTEMP_CFG_HYSTERESIS | SIMTEMP_CFG_WINDOW | \
+                                          SIMTEMP_CFG_WINDOW_SAMPLES | SIMTEMP_CFG_WINDOW_NS)
+
+/* Bits of simtemp_filter.type, a sample is delivered to the reader only when it passes every enabled filter */
+#define SIMTEMP_FILTER_NONE              0x0U /* Deliver every sample */
+#define SIMTEMP_FILTER_DECIMATE          0x1U /* Deliver one sample out of every decimation samples */
+#define SIMTEMP_FILTER_OUT_OF_BAND       0x2U /* Deliver samples below band_low_mC or above band_high_mC */
+#define SIMTEMP_FILTER_DELTA             0x4U /* Deliver samples that differ more than delta_mC from the last delivered one */
+#define SIMTEMP_FILTER_ALL               (SIMTEMP_FILTER_DECIMATE | SIMTEMP_FILTER_OUT_OF_BAND | SIMTEMP_FILTER_DELTA)
+
+
+
+/*****************************/
+/**** Struct definitions *****/
+/*****************************/
+/* @brief Fixed-size record handed to user space by read() on /dev/simtemp_devN.
+ *        read() only returns whole records, so the user buffer length should be a multiple of this size.
+ *        A gap in the sequence numbers of two consecutive records means that samples were lost.
+ */
+struct simtemp_sample {
+    __u64 timestamp_ns;  /* Time at which the sample was taken in ns, in the clock selected by simtemp_config.clock */
+    __u64 sequence;      /* Sequence number, incremented by one on every sample taken */
+    __s32 temp_mC;       /* Temperature in mC */
+    __u32 flags;         /* SIMTEMP_FLAG_* bits at the time the sample was taken */
+};
+
+/* @brief Header placed at offset 0 of the shared sample ring, mmap() /dev/simtemp_devN at offset 0 to get it.
+ *        The ring has a single consumer: only one open file of a device can map it, mmap() on any other file
+ *        fails with EBUSY until that file is closed. The same file can map it as many times as needed.
+ *        Slot i of the ring holds the sample whose sequence number is i and lives at
+ *        data_offset + (i & (capacity - 1)) * record_size. The kernel overwrites the oldest slot when the ring
+ *        is full, so a consumer keeps its own cursor and validates every copy against tail:
+ *
+ *            head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+ *            while(cursor < head)
+ *            {
+ *                sample = slot(cursor);
+ *                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *                tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+ *                if(cursor < tail)
+ *                {
+ *                    lost += tail - cursor;  (the slot was overwritten while it was copied)
+ *                    cursor = tail;
+ *                    continue;
+ *                }
+ *                consume(sample);
+ *                cursor++;
+ *            }
+ *            __atomic_store_n(&hdr->reader, cursor, __ATOMIC_RELEASE);
+ *
+ *        Once the ring is mapped, poll() on that file reports POLLIN while reader differs from head, so a
+ *        consumer only needs a system call to sleep when it has drained the ring.
+ */
+struct simtemp_ring_header {
+    __u32 magic;         /* SIMTEMP_RING_MAGIC */
+    __u32 version;       /* SIMTEMP_RING_VERSION */
+    __u32 record_size;   /* sizeof(struct simtemp_sample) */
+    __u32 capacity;      /* Number of slots, always a power of 2 */
+    __u32 data_offset;   /* Offset of slot 0 from the start of the mapping */
+    __u32 reserved;
+    __u64 head;          /* Written by the kernel: number of samples published so far */
+    __u64 tail;          /* Written by the kernel: oldest sample still present in the ring */
+    __u64 reader;        /* Written by the consumer: number of samples it has consumed */
+};
+
+/* @brief Device configuration exchanged through SIMTEMP_IOC_SET_CONFIG and SIMTEMP_IOC_GET_CONFIG.
+ *        All the fields selected by mask are validated first and then applied at once, so the timer never
+ *        observes a partially applied configuration. New fields are carved out of reserved, which must be zero,
+ *        and announced by a new SIMTEMP_CONFIG_VERSION.
+ */
+struct simtemp_config {
+    __u32 version;           /* SIMTEMP_CONFIG_VERSION */
+    __u32 mask;              /* SIMTEMP_CFG_* bits. SIMTEMP_IOC_GET_CONFIG ignores it and returns every bit but
+                              * SIMTEMP_CFG_SAMPLING_TIME, so its result can be given back to SIMTEMP_IOC_SET_CONFIG */
+    __u32 sampling_time_ms;  /* Sampling period in ms, SIMTEMP_IOC_GET_CONFIG rounds sub-millisecond periods down to 0 */
+    __s32 threshold_mC;      /* High trip point in mC, the alarm is raised above it */
+    __u32 mode;              /* SIMTEMP_MODE_* value */
+    __u32 clock;             /* SIMTEMP_CLOCK_* value used for the sample timestamps, SIMTEMP_CLOCK_MONOTONIC by default */
+    __u64 sampling_period_ns; /* Sampling period in ns, from SIMTEMP_SAMPLING_PERIOD_MIN_NS to SIMTEMP_SAMPLING_PERIOD_MAX_NS */
+    __u32 hysteresis_mC;     /* The low trip point is threshold_mC - hysteresis_mC, the alarm is cleared below it */
+    __u32 window_samples;    /* Aggregation window closes after this many samples, 0 for no limit */
+    __u64 window_ns;         /* Aggregation window closes when it spans this many ns, 0 for no limit. 1 s by default */
+    __u32 reserved[4];
+};
+
+/* @brief Per open file subscription filter, set with SIMTEMP_IOC_SET_FILTER.
+ *        The filter is evaluated by the driver when the sample is taken, so a reader is only woken up for
+ *        the samples it asked for. Setting a filter restarts the decimation count and the delta reference.
+ */
+struct simtemp_filter {
+    __u32 type;          /* SIMTEMP_FILTER_* bits */
+    __u32 decimation;    /* SIMTEMP_FILTER_DECIMATE: deliver every Nth sample, must be greater than 0 */
+    __s32 band_low_mC;   /* SIMTEMP_FILTER_OUT_OF_BAND: lower limit of the band */
+    __s32 band_high_mC;  /* SIMTEMP_FILTER_OUT_OF_BAND: upper limit of the band */
+    __u32 delta_mC;      /* SIMTEMP_FILTER_DELTA: minimum change from the last delivered sample */
+    __u32 reserved[3];
+};
+
+/* @brief Aggregate of one completed window, returned by read() on files in SIMTEMP_FORMAT_SUMMARIES.
+ *        A window closes after window_samples samples or when the next sample is window_ns or more after
+ *        its first one, whichever comes first. No summaries are produced while both limits are 0.
+ */
+struct simtemp_summary {
+    __u64 first_timestamp_ns; /* Timestamp of the first sample of the window */
+    __u64 last_timestamp_ns;  /* Timestamp of the last sample of the window */
+    __u64 first_sequence;     /* Sequence number of the first sample of the window */
+    __u32 count;              /* Number of samples aggregated */
+    __s32 min_mC;
+    __s32 max_mC;
+    __s32 mean_mC;
+};
+
+/* @brief Threshold crossing, fetched with SIMTEMP_IOC_GET_EVENT.
+ *        Only the transitions of the alarm are queued, a sensor that stays above the threshold produces a
+ *        single SIMTEMP_EVENT_RISING. poll() reports POLLPRI while the file has events queued.
+ */
+struct simtemp_event {
+    __u64 timestamp_ns;  /* Timestamp of the sample that crossed the trip point */
+    __u64 sequence;      /* Sequence number of that sample */
+    __s32 temp_mC;       /* Temperature of that sample */
+    __s32 trip_mC;       /* Trip point that was crossed */
+    __u32 type;          /* SIMTEMP_EVENT_* */
+    __u32 lost;          /* Events dropped for this file before this one because its queue was full */
+};
+
+/* @brief Waveform generator of a device, set with SIMTEMP_IOC_SET_WAVEFORM and read with SIMTEMP_IOC_GET_WAVEFORM.
+ *        The shape is selected with the mode:
+ *        SIMTEMP_MODE_NORMAL: offset_mC.
+ *        SIMTEMP_MODE_NOISY:  offset_mC plus Gaussian noise with a standard deviation of amplitude_mC.
+ *        SIMTEMP_MODE_RAMP:   triangle between ramp_low_mC and ramp_high_mC, ramp_step_mC per sample.
+ *        SIMTEMP_MODE_SINE:   offset_mC +/- amplitude_mC, one cycle every period_ns.
+ *        SIMTEMP_MODE_SQUARE: offset_mC + amplitude_mC the first half of period_ns and offset_mC - amplitude_mC the second.
+ *        The generator advances by one sampling period per sample and its noise comes from a PRNG seeded with seed,
+ *        so the same waveform and sampling period give the same stream on every run. Setting the waveform restarts it.
+ */
+struct simtemp_waveform {
+    __u64 seed;          /* PRNG seed */
+    __u64 period_ns;     /* SINE and SQUARE, SIMTEMP_WAVEFORM_PERIOD_MIN_NS to SIMTEMP_WAVEFORM_PERIOD_MAX_NS */
+    __s32 offset_mC;
+    __u32 amplitude_mC;
+    __s32 ramp_low_mC;   /* Must be lower than ramp_high_mC */
+    __s32 ramp_high_mC;
+    __u32 ramp_step_mC;  /* Greater than 0 */
+    __u32 noise_mC;      /* Standard deviation of Gaussian noise added on top of every mode, 0 disables it */
+    __u32 reserved[4];
+};
+
+/* @brief One record of a trace to replay. The trace is loaded by writing arrays of these records to the device,
+ *        every write() appends to the records already loaded, up to SIMTEMP_REPLAY_MAX_RECORDS.
+ */
+struct simtemp_replay_record {
+    __u64 delta_ns;  /* Time since the previous record, only used with SIMTEMP_REPLAY_ORIGINAL_RATE */
+    __s32 temp_mC;
+    __u32 reserved;
+};
+
+/* @brief Playback control of SIMTEMP_MODE_REPLAY, set with SIMTEMP_IOC_SET_REPLAY and read with SIMTEMP_IOC_GET_REPLAY.
+ *        Setting it restarts the playback from the first record.
+ */
+struct simtemp_replay {
+    __u32 flags;     /* SIMTEMP_REPLAY_* bits */
+    __u32 speed_q16; /* SIMTEMP_REPLAY_ORIGINAL_RATE time scale, 10 * SIMTEMP_REPLAY_SPEED_ONE plays 10x faster. Greater than 0 */
+    __u32 count;     /* SIMTEMP_IOC_GET_REPLAY: records loaded */
+    __u32 position;  /* SIMTEMP_IOC_GET_REPLAY: index of the next record played */
+    __u32 reserved[4];
+};
+
+/* @brief Filter chain of a device, set with SIMTEMP_IOC_SET_CHAIN and read with SIMTEMP_IOC_GET_CHAIN.
+ *        The stages run in order on every raw temperature and the result is what the samples, the threshold
+ *        check and the aggregation windows see. All the arithmetic is integer, the EMA coefficient is Q16.
+ *        Every stage type can appear once. Changing the chain restarts the state of all the stages.
+ */
+struct simtemp_filter_chain {
+    __u32 stages[SIMTEMP_CHAIN_MAX_STAGES]; /* SIMTEMP_CHAIN_* in processing order, SIMTEMP_CHAIN_NONE slots are skipped */
+    __u32 ema_alpha_q16;   /* SIMTEMP_CHAIN_EMA: 1 to SIMTEMP_CHAIN_ALPHA_ONE */
+    __u32 average_window;  /* SIMTEMP_CHAIN_MOVING_AVERAGE: 1 to SIMTEMP_CHAIN_MAX_AVERAGE_WINDOW */
+    __u32 median_window;   /* SIMTEMP_CHAIN_MEDIAN: 1 to SIMTEMP_CHAIN_MAX_MEDIAN_WINDOW */
+    __u32 reserved[5];
+};
+
+/* @brief Statistics of a device since it was created or since the last SIMTEMP_IOC_RESET_STATS, returned by
+ *        SIMTEMP_IOC_GET_STATS and shown in debugfs/simtemp/simtemp_devN/stats. The driver keeps them per CPU and
+ *        adds them up when they are read, so the fields are not a snapshot taken at one instant.
+ *        Jitter is how late the timer callback ran compared to the expiry it was programmed for.
+ */
+struct simtemp_stats {
+    __u64 timer_expirations;   /* Timer callbacks that sampled this device */
+    __u64 timer_overruns;      /* Timer periods that elapsed without a callback */
+    __u64 samples_produced;
+    __u64 samples_skipped;     /* High-rate samples not taken because the timer was more than SIMTEMP_BATCH_MAX_SAMPLES late */
+    __u64 samples_delivered;   /* Samples queued to a reader, one per reader */
+    __u64 samples_dropped;     /* Samples a reader lost because its buffer was full */
+    __u64 events;              /* Alarm transitions */
+    __u64 events_dropped;      /* Events a reader lost because its queue was full */
+    __u64 summaries;           /* Aggregation windows completed */
+    __u64 summaries_dropped;   /* Summaries a reader lost because its buffer was full */
+    __u64 callback_ns_total;   /* Time spent sampling this device in the timer callback, or in its thread */
+    __u64 callback_ns_max;
+    __u64 jitter_ns_max;
+    __u64 callback_histogram[SIMTEMP_STATS_BUCKETS];
+    __u64 jitter_histogram[SIMTEMP_STATS_BUCKETS];
+    __u64 handoffs_missed;     /* SIMTEMP_CONTEXT_THREAD: expirations that found the thread still busy with a previous one */
+    __u32 context;             /* SIMTEMP_CONTEXT_* the statistics were taken in, they are reset when it changes */
+    __u32 reserved32;
+    __u64 reserved[2];
+};
+
+/* @brief Latest sample, flags and configuration in effect, returned in one copy by SIMTEMP_IOC_GET_SNAPSHOT */
+struct simtemp_snapshot {
+    __u32 version;                 /* Set by the driver to SIMTEMP_CONFIG_VERSION */
+    __u32 flags;                   /* Current value of simtemp_sysfs_flags */
+    struct simtemp_sample sample;  /* Latest sample taken, sequence 0 and timestamp 0 before the first one */
+    struct simtemp_config config;  /* Configuration in effect */
+};
+
+
+
+/*****************************/
+/**** ioctl definitions ******/
+/*****************************/
+#define SIMTEMP_IOC_MAGIC                'S'
+#define SIMTEMP_IOC_SET_CONFIG           _IOW(SIMTEMP_IOC_MAGIC, 1, struct simtemp_config)
+#define SIMTEMP_IOC_GET_CONFIG           _IOR(SIMTEMP_IOC_MAGIC, 2, struct simtemp_config)
+#define SIMTEMP_IOC_GET_SNAPSHOT         _IOR(SIMTEMP_IOC_MAGIC, 3, struct simtemp_snapshot)
+#define SIMTEMP_IOC_SET_FILTER           _IOW(SIMTEMP_IOC_MAGIC, 4, struct simtemp_filter)
+#define SIMTEMP_IOC_GET_FILTER           _IOR(SIMTEMP_IOC_MAGIC, 5, struct simtemp_filter)
+#define SIMTEMP_IOC_GET_EVENT            _IOR(SIMTEMP_IOC_MAGIC, 6, struct simtemp_event) /* -EAGAIN when no event is queued */
+#define SIMTEMP_IOC_SET_FORMAT           _IOW(SIMTEMP_IOC_MAGIC, 7, __u32) /* SIMTEMP_FORMAT_*, discards the records queued */
+#define SIMTEMP_IOC_GET_FORMAT           _IOR(SIMTEMP_IOC_MAGIC, 8, __u32)
+#define SIMTEMP_IOC_SET_CHAIN            _IOW(SIMTEMP_IOC_MAGIC, 9, struct simtemp_filter_chain)
+#define SIMTEMP_IOC_GET_CHAIN            _IOR(SIMTEMP_IOC_MAGIC, 10, struct simtemp_filter_chain)
+#define SIMTEMP_IOC_SET_WAVEFORM         _IOW(SIMTEMP_IOC_MAGIC, 11, struct simtemp_waveform)
+#define SIMTEMP_IOC_GET_WAVEFORM         _IOR(SIMTEMP_IOC_MAGIC, 12, struct simtemp_waveform)
+#define SIMTEMP_IOC_SET_REPLAY           _IOW(SIMTEMP_IOC_MAGIC, 13, struct simtemp_replay)
+#define SIMTEMP_IOC_GET_REPLAY           _IOR(SIMTEMP_IOC_MAGIC, 14, struct simtemp_replay)
+#define SIMTEMP_IOC_GET_STATS            _IOR(SIMTEMP_IOC_MAGIC, 15, struct simtemp_stats)
+#define SIMTEMP_IOC_RESET_STATS          _IO(SIMTEMP_IOC_MAGIC, 16)
+
+#endif /* NXP_SIMTEMP_H */
@@ -0,0 +1,134 @@
+/**
+ * @file nxp_simtemp_trace.h
+ * @brief Tracepoints of the simtemp kernel module. They cost a static branch while disabled and can be
+ *        consumed with ftrace (/sys/kernel/tracing/events/simtemp) or perf (perf record -e 'simtemp:*').
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simtemp
+
+#if !defined(NXP_SIMTEMP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define NXP_SIMTEMP_TRACE_H
+
+/******************/
+/**** Includes ****/
+/******************/
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+
+
+/*****************************/
+/**** Trace events ***********/
+/*****************************/
+/* @brief A sample was taken by the timer callback */
+TRACE_EVENT(simtemp_sample,
+
+    TP_PROTO(unsigned int index, __u64 sequence, __u64 timestamp_ns, __s32 temp_mC, __u32 flags),
+
+    TP_ARGS(index, sequence, timestamp_ns, temp_mC, flags),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(__u64, sequence)
+        __field(__u64, timestamp_ns)
+        __field(__s32, temp_mC)
+        __field(__u32, flags)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->sequence = sequence;
+        __entry->timestamp_ns = timestamp_ns;
+        __entry->temp_mC = temp_mC;
+        __entry->flags = flags;
+    ),
+
+    TP_printk("dev=%u seq=%llu ts=%llu temp_mC=%d flags=0x%x",
+              __entry->index, __entry->sequence, __entry->timestamp_ns, __entry->temp_mC, __entry->flags)
+);
+
+/* @brief The alarm of a device was raised (rising) or cleared (falling) */
+TRACE_EVENT(simtemp_threshold_crossed,
+
+    TP_PROTO(unsigned int index, __u64 sequence, __s32 temp_mC, __s32 trip_mC, bool rising),
+
+    TP_ARGS(index, sequence, temp_mC, trip_mC, rising),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(__u64, sequence)
+        __field(__s32, temp_mC)
+        __field(__s32, trip_mC)
+        __field(bool, rising)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->sequence = sequence;
+        __entry->temp_mC = temp_mC;
+        __entry->trip_mC = trip_mC;
+        __entry->rising = rising;
+    ),
+
+    TP_printk("dev=%u seq=%llu temp_mC=%d trip_mC=%d %s",
+              __entry->index, __entry->sequence, __entry->temp_mC, __entry->trip_mC, __entry->rising ? "rising" : "falling")
+);
+
+/* @brief A sample was queued for a reader and the reader was woken up */
+TRACE_EVENT(simtemp_reader_wake,
+
+    TP_PROTO(unsigned int index, const void *reader, __u64 sequence, unsigned int queued),
+
+    TP_ARGS(index, reader, sequence, queued),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(const void *, reader)
+        __field(__u64, sequence)
+        __field(unsigned int, queued)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->reader = reader;
+        __entry->sequence = sequence;
+        __entry->queued = queued;
+    ),
+
+    TP_printk("dev=%u reader=%p seq=%llu queued=%u",
+              __entry->index, __entry->reader, __entry->sequence, __entry->queued)
+);
+
+/* @brief The buffer of a reader was full and the sample was dropped for that reader */
+TRACE_EVENT(simtemp_buffer_overrun,
+
+    TP_PROTO(unsigned int index, const void *reader, __u64 sequence),
+
+    TP_ARGS(index, reader, sequence),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, index)
+        __field(const void *, reader)
+        __field(__u64, sequence)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->reader = reader;
+        __entry->sequence = sequence;
+    ),
+
+    TP_printk("dev=%u reader=%p seq=%llu",
+              __entry->index, __entry->reader, __entry->sequence)
+);
+
+#endif /* NXP_SIMTEMP_TRACE_H */
+
+/* This part must be outside the header guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nxp_simtemp_trace
+#include <trace/define_trace.h>
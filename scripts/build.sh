@@ -10,4 +10,20 @@ echo "Building test app"
 # Go to user folder
 cd ..
 cd user/cli
-gcc main.c
\ No newline at end of file
+gcc main.c recorder.c
+
+echo "Building benchmarks"
+
+# Go to bench folder
+cd ..
+cd bench/
+gcc -O2 -pthread latency.c -o latency
+gcc -O2 -pthread throughput.c -o throughput
+
+echo "Building client library"
+
+# Go to lib folder
+cd ..
+cd lib/
+g++ -std=c++20 -O2 -c simtemp.cpp -o simtemp.o
+ar rcs libsimtemp.a simtemp.o
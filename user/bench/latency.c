@@ -0,0 +1,456 @@
+/* End-to-end wakeup latency benchmark of the simtemp driver.
+ *
+ * For every point of a sweep of sampling periods and reader counts it measures the time between the
+ * kernel timestamp of a record and the moment a reader sees it in user space (clock_gettime() right
+ * after read() or SIMTEMP_IOC_GET_EVENT returns), both on the POLLIN sample path and on the POLLPRI
+ * threshold event path. The results go to a log-linear (HDR style) histogram per point.
+ *
+ * Usage: latency [-d device] [-p periods_ns] [-r readers] [-n records]
+ *        periods_ns and readers are comma separated lists, for example -p 100000,1000000 -r 1,8
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "../../kernel/nxp_simtemp.h"
+
+
+
+#define DEFAULT_DEVICE          "/dev/simtemp_dev0"
+#define DEFAULT_PERIODS         "100000,1000000,10000000"
+#define DEFAULT_READERS         "1,4,16"
+#define DEFAULT_RECORDS         2000U  /* Records measured per reader and point */
+#define MAX_SWEEP_VALUES        16U
+#define MAX_READERS             256U
+#define READ_BATCH_SIZE         1024U
+#define POLL_TIMEOUT_MS         1000
+#define POINT_TIMEOUT_S         30     /* A point gives up when its readers see nothing for this long */
+
+/* Histogram: values below 2^SUB_BUCKET_BITS are exact, above that every power of two is split into
+ * 2^(SUB_BUCKET_BITS - 1) buckets, which keeps the relative error below 1% up to 2^63 ns */
+#define SUB_BUCKET_BITS         7U
+#define SUB_BUCKET_COUNT        (1U << SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF         (SUB_BUCKET_COUNT / 2U)
+#define HISTOGRAM_BUCKETS       ((64U - SUB_BUCKET_BITS + 1U) * SUB_BUCKET_HALF + SUB_BUCKET_HALF)
+
+/* Path being measured */
+#define PATH_POLLIN             0U
+#define PATH_POLLPRI            1U
+
+
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+struct reader_context {
+    const char *device;
+    unsigned int path;
+    unsigned int records;       /* Records to measure */
+    pthread_barrier_t *start;   /* Every reader starts measuring at once */
+    struct histogram histogram;
+    int error;
+};
+
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+
+
+static unsigned int histogram_index(uint64_t value)
+{
+    unsigned int exponent;
+
+    if(value < SUB_BUCKET_COUNT)
+    {
+        return (unsigned int)value;
+    }
+    exponent = (63U - (unsigned int)__builtin_clzll(value)) - (SUB_BUCKET_BITS - 1U);
+    return (exponent * SUB_BUCKET_HALF) + (unsigned int)(value >> exponent);
+}
+
+
+
+/* Highest value that falls in a bucket */
+static uint64_t histogram_value(unsigned int index)
+{
+    unsigned int exponent;
+    uint64_t mantissa;
+
+    if(index < SUB_BUCKET_COUNT)
+    {
+        return index;
+    }
+    exponent = (index / SUB_BUCKET_HALF) - 1U;
+    mantissa = index - (exponent * SUB_BUCKET_HALF);
+    return ((mantissa + 1U) << exponent) - 1U;
+}
+
+
+
+static void histogram_record(struct histogram *histogram, uint64_t value)
+{
+    histogram->counts[histogram_index(value)]++;
+    histogram->total++;
+    if(value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+
+
+static void histogram_merge(struct histogram *into, const struct histogram *from)
+{
+    unsigned int index;
+
+    for(index = 0U; index < HISTOGRAM_BUCKETS; index++)
+    {
+        into->counts[index] += from->counts[index];
+    }
+    into->total += from->total;
+    if(from->max > into->max)
+    {
+        into->max = from->max;
+    }
+}
+
+
+
+static uint64_t histogram_percentile(const struct histogram *histogram, double percentile)
+{
+    uint64_t target = (uint64_t)((percentile / 100.0) * (double)histogram->total);
+    uint64_t seen = 0U;
+    unsigned int index;
+
+    if(target == 0U)
+    {
+        target = 1U;
+    }
+    for(index = 0U; index < HISTOGRAM_BUCKETS; index++)
+    {
+        seen += histogram->counts[index];
+        if(seen >= target)
+        {
+            return (histogram_value(index) < histogram->max) ? histogram_value(index) : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+
+
+/* Measures the POLLIN path: kernel sample timestamp to the return of read() */
+static void measure_samples(struct reader_context *context, int fd)
+{
+    struct simtemp_sample samples[READ_BATCH_SIZE];
+    struct pollfd poll_fd = { .fd = fd, .events = POLLIN };
+    uint64_t last_progress = now_ns();
+    uint64_t seen;
+    ssize_t bytes_read;
+    size_t index;
+
+    while(context->histogram.total < context->records)
+    {
+        if(poll(&poll_fd, 1, POLL_TIMEOUT_MS) <= 0)
+        {
+            if((now_ns() - last_progress) > (POINT_TIMEOUT_S * 1000000000ULL))
+            {
+                context->error = ETIMEDOUT;
+                return;
+            }
+            continue;
+        }
+        bytes_read = read(fd, samples, sizeof(samples));
+        seen = now_ns();
+        if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+        {
+            continue;
+        }
+        for(index = 0U; index < ((size_t)bytes_read / sizeof(struct simtemp_sample)); index++)
+        {
+            histogram_record(&context->histogram, (seen > samples[index].timestamp_ns) ? (seen - samples[index].timestamp_ns) : 0U);
+        }
+        last_progress = seen;
+    }
+}
+
+
+
+/* Measures the POLLPRI path: kernel event timestamp to the return of SIMTEMP_IOC_GET_EVENT */
+static void measure_events(struct reader_context *context, int fd)
+{
+    struct simtemp_event event;
+    struct pollfd poll_fd = { .fd = fd, .events = POLLPRI };
+    uint64_t last_progress = now_ns();
+    uint64_t seen;
+
+    while(context->histogram.total < context->records)
+    {
+        if(poll(&poll_fd, 1, POLL_TIMEOUT_MS) <= 0)
+        {
+            if((now_ns() - last_progress) > (POINT_TIMEOUT_S * 1000000000ULL))
+            {
+                context->error = ETIMEDOUT;
+                return;
+            }
+            continue;
+        }
+        while(ioctl(fd, SIMTEMP_IOC_GET_EVENT, &event) == 0)
+        {
+            seen = now_ns();
+            histogram_record(&context->histogram, (seen > event.timestamp_ns) ? (seen - event.timestamp_ns) : 0U);
+            last_progress = seen;
+        }
+    }
+}
+
+
+
+static void *reader_thread(void *argument)
+{
+    struct reader_context *context = argument;
+    struct simtemp_sample samples[READ_BATCH_SIZE];
+    struct simtemp_event event;
+    int fd;
+
+    fd = open(context->device, O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        context->error = errno;
+        pthread_barrier_wait(context->start);
+        return NULL;
+    }
+    pthread_barrier_wait(context->start);
+    /* Records queued before the point started do not measure the wakeup latency */
+    while(read(fd, samples, sizeof(samples)) > 0)
+    {
+    }
+    while(ioctl(fd, SIMTEMP_IOC_GET_EVENT, &event) == 0)
+    {
+    }
+    if(context->path == PATH_POLLIN)
+    {
+        measure_samples(context, fd);
+    }
+    else
+    {
+        measure_events(context, fd);
+    }
+    close(fd);
+    return NULL;
+}
+
+
+
+static int configure_point(int fd, unsigned int path, uint64_t period_ns)
+{
+    struct simtemp_config config;
+    struct simtemp_waveform waveform;
+
+    memset(&config, 0, sizeof(config));
+    config.version = SIMTEMP_CONFIG_VERSION;
+    config.mask = SIMTEMP_CFG_SAMPLING_PERIOD | SIMTEMP_CFG_MODE | SIMTEMP_CFG_CLOCK;
+    config.sampling_period_ns = period_ns;
+    config.clock = SIMTEMP_CLOCK_MONOTONIC;
+    config.mode = SIMTEMP_MODE_NORMAL;
+    if(path == PATH_POLLPRI)
+    {
+        /* A square wave across the trip points raises and clears the alarm every other sample */
+        if(ioctl(fd, SIMTEMP_IOC_GET_WAVEFORM, &waveform) != 0)
+        {
+            return -1;
+        }
+        waveform.period_ns = period_ns * 4U;
+        waveform.offset_mC = 40000;
+        waveform.amplitude_mC = 5000U;
+        waveform.noise_mC = 0U;
+        if(ioctl(fd, SIMTEMP_IOC_SET_WAVEFORM, &waveform) != 0)
+        {
+            return -1;
+        }
+        config.mask |= SIMTEMP_CFG_THRESHOLD | SIMTEMP_CFG_HYSTERESIS;
+        config.mode = SIMTEMP_MODE_SQUARE;
+        config.threshold_mC = 40000;
+        config.hysteresis_mC = 1000U;
+    }
+    return ioctl(fd, SIMTEMP_IOC_SET_CONFIG, &config);
+}
+
+
+
+static int run_point(const char *device, int control_fd, unsigned int path, uint64_t period_ns, unsigned int readers,
+                     unsigned int records)
+{
+    struct reader_context *contexts;
+    pthread_t *threads;
+    pthread_barrier_t start;
+    struct histogram *total;
+    unsigned int index;
+    int error = 0;
+
+    if(configure_point(control_fd, path, period_ns) != 0)
+    {
+        fprintf(stderr, "Could not configure %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    contexts = calloc(readers, sizeof(*contexts));
+    threads = calloc(readers, sizeof(*threads));
+    total = calloc(1U, sizeof(*total));
+    if((contexts == NULL) || (threads == NULL) || (total == NULL))
+    {
+        free(contexts);
+        free(threads);
+        free(total);
+        return -1;
+    }
+    pthread_barrier_init(&start, NULL, readers);
+    for(index = 0U; index < readers; index++)
+    {
+        contexts[index].device = device;
+        contexts[index].path = path;
+        contexts[index].records = records;
+        contexts[index].start = &start;
+        pthread_create(&threads[index], NULL, reader_thread, &contexts[index]);
+    }
+    for(index = 0U; index < readers; index++)
+    {
+        pthread_join(threads[index], NULL);
+        histogram_merge(total, &contexts[index].histogram);
+        if(contexts[index].error != 0)
+        {
+            error = contexts[index].error;
+        }
+    }
+    pthread_barrier_destroy(&start);
+
+    printf("%-8s %12llu %8u %10llu %10.1f %10.1f %10.1f %10.1f%s\n", (path == PATH_POLLIN) ? "POLLIN" : "POLLPRI",
+           (unsigned long long)period_ns, readers, (unsigned long long)total->total,
+           (double)histogram_percentile(total, 50.0) / 1000.0, (double)histogram_percentile(total, 99.0) / 1000.0,
+           (double)histogram_percentile(total, 99.9) / 1000.0, (double)total->max / 1000.0,
+           (error != 0) ? "  (incomplete)" : "");
+    fflush(stdout);
+    free(contexts);
+    free(threads);
+    free(total);
+    return 0;
+}
+
+
+
+static unsigned int parse_list(const char *text, uint64_t *values)
+{
+    char *copy = strdup(text);
+    char *token;
+    char *save = NULL;
+    unsigned int count = 0U;
+
+    for(token = strtok_r(copy, ",", &save); (token != NULL) && (count < MAX_SWEEP_VALUES); token = strtok_r(NULL, ",", &save))
+    {
+        values[count] = strtoull(token, NULL, 0);
+        if(values[count] != 0U)
+        {
+            count++;
+        }
+    }
+    free(copy);
+    return count;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    const char *device = DEFAULT_DEVICE;
+    const char *periods_text = DEFAULT_PERIODS;
+    const char *readers_text = DEFAULT_READERS;
+    unsigned int records = DEFAULT_RECORDS;
+    uint64_t periods[MAX_SWEEP_VALUES];
+    uint64_t readers[MAX_SWEEP_VALUES];
+    unsigned int number_of_periods;
+    unsigned int number_of_readers;
+    struct simtemp_config saved_config;
+    struct simtemp_waveform saved_waveform;
+    unsigned int path;
+    unsigned int period_index;
+    unsigned int reader_index;
+    int control_fd;
+    int option;
+
+    while((option = getopt(argc, argv, "d:p:r:n:h")) != -1)
+    {
+        switch(option)
+        {
+            case 'd':
+                device = optarg;
+                break;
+            case 'p':
+                periods_text = optarg;
+                break;
+            case 'r':
+                readers_text = optarg;
+                break;
+            case 'n':
+                records = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-d device] [-p periods_ns] [-r readers] [-n records]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    number_of_periods = parse_list(periods_text, periods);
+    number_of_readers = parse_list(readers_text, readers);
+    if((number_of_periods == 0U) || (number_of_readers == 0U) || (records == 0U))
+    {
+        fprintf(stderr, "Empty sweep\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The configuration of the device is restored when the sweep ends */
+    control_fd = open(device, O_RDONLY);
+    if((control_fd < 0) || (ioctl(control_fd, SIMTEMP_IOC_GET_CONFIG, &saved_config) != 0) ||
+       (ioctl(control_fd, SIMTEMP_IOC_GET_WAVEFORM, &saved_waveform) != 0))
+    {
+        fprintf(stderr, "Could not open %s: %s\n", device, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    printf("Latency from the kernel timestamp to user space, in us\n");
+    printf("%-8s %12s %8s %10s %10s %10s %10s %10s\n", "path", "period_ns", "readers", "records", "p50", "p99", "p99.9", "max");
+    for(path = PATH_POLLIN; path <= PATH_POLLPRI; path++)
+    {
+        for(period_index = 0U; period_index < number_of_periods; period_index++)
+        {
+            for(reader_index = 0U; reader_index < number_of_readers; reader_index++)
+            {
+                if(readers[reader_index] > MAX_READERS)
+                {
+                    readers[reader_index] = MAX_READERS;
+                }
+                run_point(device, control_fd, path, periods[period_index], (unsigned int)readers[reader_index], records);
+            }
+        }
+    }
+
+    ioctl(control_fd, SIMTEMP_IOC_SET_WAVEFORM, &saved_waveform);
+    ioctl(control_fd, SIMTEMP_IOC_SET_CONFIG, &saved_config);
+    close(control_fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,619 @@
+/* Sustained throughput and sample loss benchmark of the simtemp driver.
+ *
+ * Drives one or many devices at increasing sampling rates and, for every consumer strategy, measures
+ * how many of the samples produced during each step reach the consumer and how much consumer CPU it
+ * takes per sample. A strategy stops at the first rate that loses samples, the previous one is its
+ * highest lossless rate. Strategies:
+ *
+ *   sysfs  reads simtemp_sysfs_temp_mC in a loop, the way the scripts scrape the driver
+ *   poll   poll() + one read() per sample
+ *   batch  poll() + read() of up to 1024 samples
+ *   mmap   poll() + the shared ring, no copy through read()
+ *
+ * The devices run a ramp of 1 mC per sample so every sample has a distinct temperature, which is how
+ * the sysfs strategy tells samples apart. One consumer thread per device. Results go to stdout (or -o)
+ * as CSV or JSON, a summary goes to stderr.
+ *
+ * Usage: throughput [-c devices] [-s strategies] [-r start_hz] [-R max_hz] [-t seconds] [-f csv|json] [-o file]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "../../kernel/nxp_simtemp.h"
+
+
+
+#define DEVICE_PATH_FORMAT      "/dev/simtemp_dev%u"
+#define SYSFS_PATH_FORMAT       "/sys/class/simtemp_class/simtemp_dev%u/simtemp_sysfs_temp_mC"
+#define DEFAULT_START_HZ        1000ULL
+#define DEFAULT_MAX_HZ          100000ULL  /* SIMTEMP_SAMPLING_PERIOD_MIN_NS */
+#define DEFAULT_STEP_SECONDS    2U
+#define MAX_DEVICES             1024U
+#define READ_BATCH_SIZE         1024U
+#define POLL_TIMEOUT_MS         100
+
+/* Consumer strategies */
+#define STRATEGY_SYSFS          0U
+#define STRATEGY_POLL           1U
+#define STRATEGY_BATCH          2U
+#define STRATEGY_MMAP           3U
+#define STRATEGY_COUNT          4U
+
+#define OUTPUT_CSV              0U
+#define OUTPUT_JSON             1U
+
+
+
+static const char *const strategy_names[STRATEGY_COUNT] = { "sysfs", "poll", "batch", "mmap" };
+
+struct consumer {
+    unsigned int index;        /* N of /dev/simtemp_devN */
+    unsigned int strategy;
+    uint64_t deadline_ns;      /* CLOCK_MONOTONIC end of the step */
+    uint64_t first_sequence;   /* Samples after this one are counted */
+    pthread_barrier_t *start;
+    /* Results */
+    uint64_t produced;
+    uint64_t received;
+    uint64_t cpu_ns;
+    int error;
+};
+
+struct step_result {
+    unsigned int strategy;
+    unsigned int devices;
+    uint64_t rate_hz;
+    uint64_t produced;
+    uint64_t received;
+    double cpu_ns_per_sample;
+};
+
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+
+
+static uint64_t thread_cpu_ns(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_THREAD, &usage);
+    return ((uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL) +
+           ((uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL);
+}
+
+
+
+/* Sequence number of the latest sample of a device */
+static uint64_t latest_sequence(int fd)
+{
+    struct simtemp_snapshot snapshot;
+
+    if(ioctl(fd, SIMTEMP_IOC_GET_SNAPSHOT, &snapshot) != 0)
+    {
+        return 0U;
+    }
+    return snapshot.sample.sequence;
+}
+
+
+
+/* Counts the samples of a batch that belong to the step */
+static uint64_t count_in_step(const struct simtemp_sample *samples, size_t count, uint64_t first, uint64_t last)
+{
+    uint64_t counted = 0U;
+    size_t index;
+
+    for(index = 0U; index < count; index++)
+    {
+        if((samples[index].sequence > first) && (samples[index].sequence <= last))
+        {
+            counted++;
+        }
+    }
+    return counted;
+}
+
+
+
+static void consume_sysfs(struct consumer *consumer, int fd)
+{
+    char path[128];
+    char text[32];
+    long long value;
+    long long previous;
+    ssize_t length;
+    int sysfs_fd;
+
+    snprintf(path, sizeof(path), SYSFS_PATH_FORMAT, consumer->index);
+    sysfs_fd = open(path, O_RDONLY);
+    if(sysfs_fd < 0)
+    {
+        consumer->error = errno;
+        return;
+    }
+    length = pread(sysfs_fd, text, sizeof(text) - 1U, 0);
+    text[(length > 0) ? length : 0] = '\0';
+    previous = strtoll(text, NULL, 10);
+    /* sysfs only shows the latest value, a sample is seen when the value changes */
+    while(now_ns() < consumer->deadline_ns)
+    {
+        length = pread(sysfs_fd, text, sizeof(text) - 1U, 0);
+        if(length <= 0)
+        {
+            continue;
+        }
+        text[length] = '\0';
+        value = strtoll(text, NULL, 10);
+        if(value != previous)
+        {
+            consumer->received++;
+            previous = value;
+        }
+    }
+    consumer->produced = latest_sequence(fd) - consumer->first_sequence;
+    if(consumer->received > consumer->produced)
+    {
+        consumer->received = consumer->produced;
+    }
+    close(sysfs_fd);
+}
+
+
+
+static void consume_read(struct consumer *consumer, int fd, size_t batch)
+{
+    struct simtemp_sample samples[READ_BATCH_SIZE];
+    struct pollfd poll_fd = { .fd = fd, .events = POLLIN };
+    uint64_t last;
+    ssize_t bytes_read;
+
+    while(now_ns() < consumer->deadline_ns)
+    {
+        if(poll(&poll_fd, 1, POLL_TIMEOUT_MS) <= 0)
+        {
+            continue;
+        }
+        bytes_read = read(fd, samples, batch * sizeof(struct simtemp_sample));
+        if(bytes_read > 0)
+        {
+            consumer->received += count_in_step(samples, (size_t)bytes_read / sizeof(struct simtemp_sample),
+                                                 consumer->first_sequence, UINT64_MAX);
+        }
+    }
+    /* What was produced during the step and is still queued is not lost */
+    last = latest_sequence(fd);
+    consumer->produced = last - consumer->first_sequence;
+    while((bytes_read = read(fd, samples, sizeof(samples))) > 0)
+    {
+        consumer->received += count_in_step(samples, (size_t)bytes_read / sizeof(struct simtemp_sample),
+                                             consumer->first_sequence, last);
+    }
+    if(consumer->received > consumer->produced)
+    {
+        consumer->received = consumer->produced;
+    }
+}
+
+
+
+static void consume_mmap(struct consumer *consumer, int fd)
+{
+    struct simtemp_ring_header *ring;
+    const struct simtemp_sample *slots;
+    struct simtemp_sample sample;
+    struct pollfd poll_fd = { .fd = fd, .events = POLLIN };
+    size_t length = (size_t)sysconf(_SC_PAGESIZE);
+    uint64_t cursor;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t last = UINT64_MAX;
+    bool draining = false;
+
+    /* Map the header first to learn the size of the ring */
+    ring = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    if(ring == MAP_FAILED)
+    {
+        consumer->error = errno;
+        return;
+    }
+    length = ring->data_offset + ((size_t)ring->capacity * ring->record_size);
+    munmap(ring, (size_t)sysconf(_SC_PAGESIZE));
+    ring = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(ring == MAP_FAILED)
+    {
+        consumer->error = errno;
+        return;
+    }
+    slots = (const struct simtemp_sample *)((const char *)ring + ring->data_offset);
+
+    /* Slot i holds sequence i, the first sample of the step is first_sequence + 1 */
+    cursor = consumer->first_sequence + 1U;
+    while(true)
+    {
+        if(!draining && (now_ns() >= consumer->deadline_ns))
+        {
+            last = latest_sequence(fd);
+            consumer->produced = last - consumer->first_sequence;
+            draining = true;
+        }
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if(draining && (head > last + 1U))
+        {
+            head = last + 1U;
+        }
+        while(cursor < head)
+        {
+            sample = slots[cursor & (ring->capacity - 1U)];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+            if(cursor < tail)
+            {
+                /* Overwritten before it was consumed, counted as lost */
+                cursor = tail;
+                continue;
+            }
+            consumer->received += (sample.sequence == cursor) ? 1U : 0U;
+            cursor++;
+        }
+        __atomic_store_n(&ring->reader, cursor, __ATOMIC_RELEASE);
+        if(draining)
+        {
+            break;
+        }
+        poll(&poll_fd, 1, POLL_TIMEOUT_MS);
+    }
+    if(consumer->received > consumer->produced)
+    {
+        consumer->received = consumer->produced;
+    }
+    munmap(ring, length);
+}
+
+
+
+static void *consumer_thread(void *argument)
+{
+    struct consumer *consumer = argument;
+    struct simtemp_sample samples[READ_BATCH_SIZE];
+    char path[64];
+    uint64_t cpu_start;
+    int fd;
+
+    snprintf(path, sizeof(path), DEVICE_PATH_FORMAT, consumer->index);
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        consumer->error = errno;
+        pthread_barrier_wait(consumer->start);
+        return NULL;
+    }
+    /* Start with an empty queue */
+    while(read(fd, samples, sizeof(samples)) > 0)
+    {
+    }
+    pthread_barrier_wait(consumer->start);
+    consumer->first_sequence = latest_sequence(fd);
+    cpu_start = thread_cpu_ns();
+    switch(consumer->strategy)
+    {
+        case STRATEGY_SYSFS:
+            consume_sysfs(consumer, fd);
+            break;
+        case STRATEGY_POLL:
+            consume_read(consumer, fd, 1U);
+            break;
+        case STRATEGY_BATCH:
+            consume_read(consumer, fd, READ_BATCH_SIZE);
+            break;
+        default:
+            consume_mmap(consumer, fd);
+            break;
+    }
+    consumer->cpu_ns = thread_cpu_ns() - cpu_start;
+    close(fd);
+    return NULL;
+}
+
+
+
+/* Sets the sampling rate and a ramp of 1 mC per sample on every device */
+static int configure_devices(const int *control_fds, unsigned int devices, uint64_t rate_hz)
+{
+    struct simtemp_config config;
+    struct simtemp_waveform waveform;
+    unsigned int index;
+
+    for(index = 0U; index < devices; index++)
+    {
+        if(ioctl(control_fds[index], SIMTEMP_IOC_GET_WAVEFORM, &waveform) != 0)
+        {
+            return -1;
+        }
+        waveform.offset_mC = 0;
+        waveform.ramp_low_mC = 0;
+        waveform.ramp_high_mC = INT32_MAX;
+        waveform.ramp_step_mC = 1U;
+        waveform.noise_mC = 0U;
+        memset(&config, 0, sizeof(config));
+        config.version = SIMTEMP_CONFIG_VERSION;
+        config.mask = SIMTEMP_CFG_SAMPLING_PERIOD | SIMTEMP_CFG_MODE;
+        config.sampling_period_ns = 1000000000ULL / rate_hz;
+        config.mode = SIMTEMP_MODE_RAMP;
+        if((ioctl(control_fds[index], SIMTEMP_IOC_SET_WAVEFORM, &waveform) != 0) ||
+           (ioctl(control_fds[index], SIMTEMP_IOC_SET_CONFIG, &config) != 0))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+static int run_step(const int *control_fds, unsigned int devices, unsigned int strategy, uint64_t rate_hz,
+                    unsigned int seconds, struct step_result *result)
+{
+    struct consumer *consumers;
+    pthread_t *threads;
+    pthread_barrier_t start;
+    uint64_t cpu_ns = 0U;
+    unsigned int index;
+    int error = 0;
+
+    if(configure_devices(control_fds, devices, rate_hz) != 0)
+    {
+        fprintf(stderr, "Could not configure the devices: %s\n", strerror(errno));
+        return -1;
+    }
+    consumers = calloc(devices, sizeof(*consumers));
+    threads = calloc(devices, sizeof(*threads));
+    if((consumers == NULL) || (threads == NULL))
+    {
+        free(consumers);
+        free(threads);
+        return -1;
+    }
+    /* Let the new period settle before counting */
+    usleep(100000);
+    pthread_barrier_init(&start, NULL, devices);
+    for(index = 0U; index < devices; index++)
+    {
+        consumers[index].index = index;
+        consumers[index].strategy = strategy;
+        consumers[index].deadline_ns = now_ns() + ((uint64_t)seconds * 1000000000ULL);
+        consumers[index].start = &start;
+        pthread_create(&threads[index], NULL, consumer_thread, &consumers[index]);
+    }
+    memset(result, 0, sizeof(*result));
+    result->strategy = strategy;
+    result->devices = devices;
+    result->rate_hz = rate_hz;
+    for(index = 0U; index < devices; index++)
+    {
+        pthread_join(threads[index], NULL);
+        result->produced += consumers[index].produced;
+        result->received += consumers[index].received;
+        cpu_ns += consumers[index].cpu_ns;
+        if(consumers[index].error != 0)
+        {
+            error = consumers[index].error;
+        }
+    }
+    pthread_barrier_destroy(&start);
+    result->cpu_ns_per_sample = (result->received != 0U) ? ((double)cpu_ns / (double)result->received) : 0.0;
+    free(consumers);
+    free(threads);
+    if(error != 0)
+    {
+        fprintf(stderr, "%s: %s\n", strategy_names[strategy], strerror(error));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+static void print_result(FILE *output, unsigned int format, const struct step_result *result, bool first)
+{
+    uint64_t lost = result->produced - result->received;
+
+    if(format == OUTPUT_CSV)
+    {
+        fprintf(output, "%s,%u,%llu,%llu,%llu,%llu,%.1f\n", strategy_names[result->strategy], result->devices,
+                (unsigned long long)result->rate_hz, (unsigned long long)result->produced,
+                (unsigned long long)result->received, (unsigned long long)lost, result->cpu_ns_per_sample);
+    }
+    else
+    {
+        fprintf(output, "%s    {\"strategy\": \"%s\", \"devices\": %u, \"rate_hz\": %llu, \"produced\": %llu, "
+                "\"received\": %llu, \"lost\": %llu, \"cpu_ns_per_sample\": %.1f}", first ? "" : ",\n",
+                strategy_names[result->strategy], result->devices, (unsigned long long)result->rate_hz,
+                (unsigned long long)result->produced, (unsigned long long)result->received,
+                (unsigned long long)lost, result->cpu_ns_per_sample);
+    }
+    fflush(output);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int devices = 1U;
+    uint64_t start_hz = DEFAULT_START_HZ;
+    uint64_t max_hz = DEFAULT_MAX_HZ;
+    unsigned int seconds = DEFAULT_STEP_SECONDS;
+    unsigned int format = OUTPUT_CSV;
+    bool selected[STRATEGY_COUNT] = { true, true, true, true };
+    uint64_t lossless[STRATEGY_COUNT] = { 0U };
+    struct simtemp_config *saved_configs;
+    struct simtemp_waveform *saved_waveforms;
+    struct step_result result;
+    FILE *output = stdout;
+    char path[64];
+    char *token;
+    char *save = NULL;
+    int *control_fds;
+    uint64_t rate_hz;
+    unsigned int strategy;
+    unsigned int index;
+    bool first = true;
+    int option;
+
+    while((option = getopt(argc, argv, "c:s:r:R:t:f:o:h")) != -1)
+    {
+        switch(option)
+        {
+            case 'c':
+                devices = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                memset(selected, 0, sizeof(selected));
+                for(token = strtok_r(optarg, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save))
+                {
+                    for(strategy = 0U; strategy < STRATEGY_COUNT; strategy++)
+                    {
+                        selected[strategy] = selected[strategy] || (strcmp(token, strategy_names[strategy]) == 0);
+                    }
+                }
+                break;
+            case 'r':
+                start_hz = strtoull(optarg, NULL, 0);
+                break;
+            case 'R':
+                max_hz = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                seconds = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                format = (strcmp(optarg, "json") == 0) ? OUTPUT_JSON : OUTPUT_CSV;
+                break;
+            case 'o':
+                output = fopen(optarg, "w");
+                if(output == NULL)
+                {
+                    perror(optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c devices] [-s sysfs,poll,batch,mmap] [-r start_hz] [-R max_hz] "
+                        "[-t seconds] [-f csv|json] [-o file]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if((devices == 0U) || (devices > MAX_DEVICES) || (start_hz == 0U) || (max_hz < start_hz) || (seconds == 0U) ||
+       ((1000000000ULL / max_hz) < SIMTEMP_SAMPLING_PERIOD_MIN_NS))
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The configuration of every device is restored at the end */
+    control_fds = calloc(devices, sizeof(*control_fds));
+    saved_configs = calloc(devices, sizeof(*saved_configs));
+    saved_waveforms = calloc(devices, sizeof(*saved_waveforms));
+    if((control_fds == NULL) || (saved_configs == NULL) || (saved_waveforms == NULL))
+    {
+        return EXIT_FAILURE;
+    }
+    for(index = 0U; index < devices; index++)
+    {
+        snprintf(path, sizeof(path), DEVICE_PATH_FORMAT, index);
+        control_fds[index] = open(path, O_RDONLY);
+        if((control_fds[index] < 0) || (ioctl(control_fds[index], SIMTEMP_IOC_GET_CONFIG, &saved_configs[index]) != 0) ||
+           (ioctl(control_fds[index], SIMTEMP_IOC_GET_WAVEFORM, &saved_waveforms[index]) != 0))
+        {
+            fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(format == OUTPUT_CSV)
+    {
+        fprintf(output, "strategy,devices,rate_hz,produced,received,lost,cpu_ns_per_sample\n");
+    }
+    else
+    {
+        fprintf(output, "{\n  \"results\": [\n");
+    }
+    for(strategy = 0U; strategy < STRATEGY_COUNT; strategy++)
+    {
+        if(!selected[strategy])
+        {
+            continue;
+        }
+        /* Double the rate until samples are lost, the last step runs at max_hz */
+        for(rate_hz = start_hz; rate_hz != 0U; rate_hz = (rate_hz == max_hz) ? 0U : ((rate_hz * 2U > max_hz) ? max_hz : rate_hz * 2U))
+        {
+            if(run_step(control_fds, devices, strategy, rate_hz, seconds, &result) != 0)
+            {
+                break;
+            }
+            print_result(output, format, &result, first);
+            first = false;
+            if(result.received != result.produced)
+            {
+                break;
+            }
+            lossless[strategy] = rate_hz;
+        }
+    }
+    if(format == OUTPUT_JSON)
+    {
+        fprintf(output, "\n  ],\n  \"max_lossless_rate_hz\": {");
+        first = true;
+        for(strategy = 0U; strategy < STRATEGY_COUNT; strategy++)
+        {
+            if(selected[strategy])
+            {
+                fprintf(output, "%s\"%s\": %llu", first ? "" : ", ", strategy_names[strategy], (unsigned long long)lossless[strategy]);
+                first = false;
+            }
+        }
+        fprintf(output, "}\n}\n");
+    }
+    for(strategy = 0U; strategy < STRATEGY_COUNT; strategy++)
+    {
+        if(selected[strategy])
+        {
+            fprintf(stderr, "%-6s highest lossless rate with %u devices: %llu Hz\n", strategy_names[strategy], devices,
+                    (unsigned long long)lossless[strategy]);
+        }
+    }
+
+    for(index = 0U; index < devices; index++)
+    {
+        ioctl(control_fds[index], SIMTEMP_IOC_SET_WAVEFORM, &saved_waveforms[index]);
+        ioctl(control_fds[index], SIMTEMP_IOC_SET_CONFIG, &saved_configs[index]);
+        close(control_fds[index]);
+    }
+    if(output != stdout)
+    {
+        fclose(output);
+    }
+    free(control_fds);
+    free(saved_configs);
+    free(saved_waveforms);
+    return EXIT_SUCCESS;
+}
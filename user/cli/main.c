@@ -5,6 +5,15 @@
 #include <sys/ioctl.h>
 #include <string.h>
 #include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <glob.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <getopt.h>
+#include <stdint.h>
+#include "../../kernel/nxp_simtemp.h"
+#include "recorder.h"
 
 
 
@@ -15,7 +24,27 @@
 #define MENU_READ_TEMP                 4U
 #define MENU_READ_TEMP_SEVERAL_RECORDS 5U
 #define MENU_TEST_MODE                 6U
-#define MENU_EXIT                      7U
+#define MENU_READ_SUMMARY              7U
+#define MENU_EXIT                      8U
+
+/* Maximum number of samples retrieved with a single read() */
+#define SAMPLE_BATCH_SIZE           1024U
+
+/* Daemon mode */
+#define DAEMON_DEVICE_PATTERN       "/dev/simtemp_dev*"
+#define DAEMON_MAX_EVENTS            256   /* Ready devices handled per epoll_wait() */
+#define DAEMON_MAX_READS_PER_WAKEUP    4U  /* Batches read from one device before serving the next one */
+#define DAEMON_REPORT_PERIOD_MS     1000   /* Period of the statistics line */
+
+/* Stream mode */
+#define STREAM_DEFAULT_DEVICE       "/dev/simtemp_dev0"
+#define STREAM_BUFFER_BYTES         (4U * 1024U * 1024U) /* Output written with one write() per full buffer */
+#define STREAM_CSV_LINE_MAX          80U /* Longest CSV line: four numbers, three commas and the newline */
+#define STREAM_FORMAT_CSV             0U
+#define STREAM_FORMAT_BIN             1U
+
+/* Query mode */
+#define QUERY_CSV_BUFFER_BYTES      (SIMREC_BLOCK_SAMPLES * STREAM_CSV_LINE_MAX) /* One decoded block formatted at once */
 
 
 
@@ -29,7 +58,19 @@
 int sampling_time = 200;      /* Temperature sampling time, by default it is set to 200ms */
 int period_counter = 0;       /* Variable to count the periods to get the temperature and the alerts */
 int deviceFile;               /* Varible that holds the result of opening the device file */
-char sysfs_read_buffer[256];  /* Variable that holds the returned information from a sysfs read operation */
+struct simtemp_sample sample_buffer[SAMPLE_BATCH_SIZE]; /* Samples returned by the last read() on the device file */
+unsigned long long next_sequence = 0;                   /* Sequence number expected on the next sample */
+volatile sig_atomic_t daemon_running = 1;               /* Cleared by SIGINT and SIGTERM to stop the daemon and the stream */
+
+/* State of one device watched by the daemon */
+struct daemon_device {
+    int fd;
+    char path[64];
+    unsigned long long next_sequence; /* Sequence number expected on the next sample, 0 before the first one */
+    unsigned long long samples;       /* Samples read since the previous report */
+    unsigned long long lost;          /* Samples lost since the start, from the gaps in the sequence numbers */
+    int last_temp_mC;
+};
 
 
 int print_menu(void)
@@ -38,11 +79,12 @@ int print_menu(void)
     printf("NXP Simtemp Application \n");
     printf("1. Configure sampling period \n");
     printf("2. Configure threshold \n");
-    printf("3. Configure Mode (Normal, Noisy, Ramp) \n");
+    printf("3. Configure Mode (Normal, Noisy, Ramp, Sine, Square, Replay) \n");
     printf("4. Read temperature and timestamp \n");
     printf("5. Read temperature and timestamp (Several Records) \n");
     printf("6. Test mode \n");
-    printf("7. Exit \n");
+    printf("7. Read temperature summary (Aggregation window) \n");
+    printf("8. Exit \n");
     printf("Choose an option: ");
     scanf("%d", &option);
     return option;
@@ -67,113 +109,79 @@ void stop_system()
 
 
 
-void write_sysfs_file_integer_value(char * sysfs_path, char * message_input)
+int apply_config(struct simtemp_config * config)
 {
-    int fd;
-    int value;
-    int data_len;
-    char buffer[32];
-
-    /* Request the data to be written to the sysfs file */
-    printf("%s", message_input);
-    scanf("%d", &value);
-
-    /* Open the sysfs file */
-    fd = open(sysfs_path, O_WRONLY);
-    if(fd == -1)
+    /* Every field selected by config->mask is applied at once by the driver */
+    config->version = SIMTEMP_CONFIG_VERSION;
+    if(ioctl(deviceFile, SIMTEMP_IOC_SET_CONFIG, config) == -1)
     {
-        printf("Error Opening the Sysfs file \n");
+        perror("Error applying the configuration");
+        return -1;
     }
-    else
+    printf("The value has been written succesfully! \n");
+
+    /* Keep the local copy of the sampling time in sync, it is used as poll timeout */
+    if(ioctl(deviceFile, SIMTEMP_IOC_GET_CONFIG, config) == 0)
     {
-        /* Convert integer value to string */
-        data_len = snprintf(buffer, sizeof(buffer), "%d\n", value);
-        if (data_len < 0)
-        {
-            printf("Error Converting the inpunt integer value to string \n");
-            close(fd);
-        }
-        else
-        {
-            /* Write the string to the sysfs file */
-            if(write(fd, buffer, data_len) == -1)
-            {
-                close(fd);
-                printf("Error writing to the sysfs file \n");
-            }
-            else
-            {
-                printf("The value has been written succesfully! \n");
-            }
-        }
+        sampling_time = (int)((config->sampling_period_ns + 999999ULL) / 1000000ULL);
     }
-
-    close(fd);
+    return 0;
 }
 
 
 
-void write_sysfs_file_integer_value_no_scanf(char * sysfs_path, int val)
+void write_config_value(unsigned int mask, char * message_input)
 {
-    int fd;
-    int data_len;
-    char buffer[32];
+    struct simtemp_config config;
+    int value;
 
-    /* Open the sysfs file */
-    fd = open(sysfs_path, O_WRONLY);
-    if(fd == -1)
-    {
-        printf("Error Opening the Sysfs file \n");
-    }
-    else
-    {
-        /* Convert integer value to string */
-        data_len = snprintf(buffer, sizeof(buffer), "%d\n", val);
-        if (data_len < 0)
-        {
-            printf("Error Converting the inpunt integer value to string \n");
-            close(fd);
-        }
-        else
-        {
-            /* Write the string to the sysfs file */
-            if(write(fd, buffer, data_len) == -1)
-            {
-                close(fd);
-                printf("Error writing to the sysfs file \n");
-            }
-            else
-            {
-                printf("The value has been written succesfully! \n");
-            }
-        }
-    }
+    /* Request the data to be written */
+    printf("%s", message_input);
+    scanf("%d", &value);
 
-    close(fd);
+    memset(&config, 0, sizeof(config));
+    config.mask = mask;
+    config.sampling_time_ms = (unsigned int)value;
+    config.threshold_mC = value;
+    config.mode = (unsigned int)value;
+    apply_config(&config);
 }
 
 
 
-void read_sysfs_file(char * sysfs_path, char * printMessage)
+void print_timestamp(unsigned long long timestamp_ns)
 {
-    FILE *fd = NULL;
-    fd = fopen(sysfs_path, "r");
-    if(fd != NULL)
+    struct simtemp_config config;
+    struct timespec now_real;
+    struct timespec now_clock;
+    clockid_t clock_id = CLOCK_MONOTONIC;
+    time_t seconds;
+    struct tm tm;
+
+    /* The driver stamps the samples with the clock selected in its configuration, move the stamp
+     * to the real time clock using the current offset between both clocks */
+    if(ioctl(deviceFile, SIMTEMP_IOC_GET_CONFIG, &config) == 0)
     {
-        if(fgets(sysfs_read_buffer, sizeof(sysfs_read_buffer), fd) != NULL)
+        if(config.clock == SIMTEMP_CLOCK_REALTIME)
         {
-            printf("%s: %s\n", printMessage, sysfs_read_buffer);
-            fclose(fd);
+            clock_id = CLOCK_REALTIME;
         }
-        else
+        else if(config.clock == SIMTEMP_CLOCK_BOOTTIME)
         {
-            printf("Error reading the sysfs file \n");
+            clock_id = CLOCK_BOOTTIME;
         }
     }
-    else
+    if(clock_id != CLOCK_REALTIME)
     {
-        printf("Error opening the sysfs file \n");
+        clock_gettime(CLOCK_REALTIME, &now_real);
+        clock_gettime(clock_id, &now_clock);
+        timestamp_ns = timestamp_ns + ((unsigned long long)now_real.tv_sec * 1000000000ULL + (unsigned long long)now_real.tv_nsec)
+                                    - ((unsigned long long)now_clock.tv_sec * 1000000000ULL + (unsigned long long)now_clock.tv_nsec);
     }
+    seconds = (time_t)(timestamp_ns / 1000000000ULL);
+    gmtime_r(&seconds, &tm);
+    printf("Time Stamp: %d-%d-%d, T%d:%d:%d:%llu\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+           tm.tm_hour, tm.tm_min, tm.tm_sec, (timestamp_ns / 1000000ULL) % 1000ULL);
 }
 
 
@@ -182,9 +190,11 @@ void read_temperature_and_timestamp()
 {
     /* Poll variables */
     struct pollfd my_poll;
-    
-    /* Support variables for printing sysfs variables */
-    int threshold_crossed;
+
+    /* Support variables for reading the samples */
+    ssize_t bytes_read;
+    size_t number_of_samples;
+    struct simtemp_sample *latest;
 
     /* Poll initialization */
     memset(&my_poll, 0, sizeof(my_poll));
@@ -192,29 +202,49 @@ void read_temperature_and_timestamp()
     my_poll.events = POLLIN;
     period_counter = 0;
 
+    /* The driver drops the newest samples while the buffer of the file is full, so after the menu sat idle the
+     * buffer only holds old ones. Discard them and wait for a fresh sample */
+    while((poll(&my_poll, 1, 0) > 0) && (my_poll.revents & POLLIN))
+    {
+        bytes_read = read(deviceFile, sample_buffer, sizeof(sample_buffer));
+        if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+        {
+            break;
+        }
+        number_of_samples = (size_t)bytes_read / sizeof(struct simtemp_sample);
+        next_sequence = sample_buffer[number_of_samples - 1U].sequence + 1U;
+    }
+
     while(1)
     {
         poll(&my_poll, 1, sampling_time);
         if(my_poll.revents & POLLIN)
         {
-            /* Temperature */
-            read_sysfs_file("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_temp_mC", "Temperature reading in mC");
-            
-            /* Sampling time */
-            read_sysfs_file("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_sampling_time", "Sampling Time");
-            sampling_time = atoi(sysfs_read_buffer);
-            printf("It took %d ms to get the temperature. \n", sampling_time * period_counter);
-            
-            /* TimeStamp */
-            read_sysfs_file("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_timestamp", "Time Stamp");
+            /* Retrieve every pending sample with a single system call */
+            bytes_read = read(deviceFile, sample_buffer, sizeof(sample_buffer));
+            if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+            {
+                printf("Error reading the device file \n");
+                break;
+            }
+            number_of_samples = (size_t)bytes_read / sizeof(struct simtemp_sample);
+            latest = &sample_buffer[number_of_samples - 1U];
 
-            /* Threshold */
-            read_sysfs_file("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_temperature_threshold", "Threshold");
+            /* Detect lost samples through the gaps in the sequence numbers */
+            if((next_sequence != 0U) && (sample_buffer[0].sequence != next_sequence))
+            {
+                printf("WARNING: %llu samples were lost \n", (unsigned long long)(sample_buffer[0].sequence - next_sequence));
+            }
+            next_sequence = latest->sequence + 1U;
 
-            /* Flags */
-            read_sysfs_file("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_flags", "Flag Variable Value");
-            threshold_crossed = (int)sysfs_read_buffer[0];
-            if(threshold_crossed & 0x02)
+            /* Print the most recent sample */
+            printf("Samples retrieved: %zu \n", number_of_samples);
+            printf("Temperature reading in mC: %d\n", latest->temp_mC);
+            printf("It took %d ms to get the temperature. \n", sampling_time * period_counter);
+            print_timestamp(latest->timestamp_ns);
+            printf("Sequence Number: %llu\n", (unsigned long long)latest->sequence);
+            printf("Flag Variable Value: %u\n", latest->flags);
+            if(latest->flags & SIMTEMP_FLAG_THRESHOLD_CROSSED)
             {
                 printf("ALERT: threshold has been crossed!\n");
             }
@@ -254,6 +284,9 @@ void enter_test_mode(void)
 {
     /* Poll variables */
     struct pollfd my_poll;
+    struct simtemp_config config;
+    struct simtemp_event event;
+    struct simtemp_snapshot snapshot;
 
     /* Variables setting */
     period_counter = 0;
@@ -264,11 +297,23 @@ void enter_test_mode(void)
     my_poll.events = POLLPRI;
     period_counter = 0;
 
-    /* Set the acquisition mode to Normal */
-    write_sysfs_file_integer_value_no_scanf("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_mode", 0U);
+    /* Discard the threshold events queued before the test */
+    while(ioctl(deviceFile, SIMTEMP_IOC_GET_EVENT, &event) == 0)
+    {
+    }
+    /* Only a rising crossing raises POLLPRI, there is nothing to detect if the alarm is already active */
+    if((ioctl(deviceFile, SIMTEMP_IOC_GET_SNAPSHOT, &snapshot) == 0) && (snapshot.flags & SIMTEMP_FLAG_THRESHOLD_CROSSED))
+    {
+        printf("The threshold alarm is already active. \n");
+        return;
+    }
 
-    /* Set the temperature threshold slightly below the Normal Temperature */
-    write_sysfs_file_integer_value_no_scanf("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_temperature_threshold", 31000U);
+    /* Set the acquisition mode to Normal and the temperature threshold slightly below the Normal Temperature in one call */
+    memset(&config, 0, sizeof(config));
+    config.mask = SIMTEMP_CFG_MODE | SIMTEMP_CFG_THRESHOLD;
+    config.mode = SIMTEMP_MODE_NORMAL;
+    config.threshold_mC = 31000;
+    apply_config(&config);
 
     /* Wait for the poll event to detect the fault */
     while(1)
@@ -276,6 +321,12 @@ void enter_test_mode(void)
         poll(&my_poll, 1, sampling_time);
         if(my_poll.revents & POLLPRI)
         {
+            /* POLLPRI stays raised until the queued events are fetched */
+            while(ioctl(deviceFile, SIMTEMP_IOC_GET_EVENT, &event) == 0)
+            {
+                printf("%s event: %d mC crossed %d mC (sequence %llu)\n", (event.type == SIMTEMP_EVENT_RISING) ? "Rising" : "Falling",
+                       event.temp_mC, event.trip_mC, (unsigned long long)event.sequence);
+            }
             printf("It took %d ms to detect the fault. \n", sampling_time * period_counter);
             break;
         }
@@ -288,11 +339,790 @@ void enter_test_mode(void)
 
 
 
-int main()
+void read_temperature_summary(void)
+{
+    struct pollfd my_poll;
+    struct simtemp_summary summary;
+    struct simtemp_config config;
+    unsigned int format = SIMTEMP_FORMAT_SUMMARIES;
+    int summary_file;
+    int timeout_ms = -1;
+
+    /* A second file is opened so that the sample stream of deviceFile is left untouched */
+    summary_file = open("/dev/simtemp_dev0", O_RDONLY);
+    if(summary_file < 0)
+    {
+        perror("Could not open the device file");
+        return;
+    }
+    if(ioctl(summary_file, SIMTEMP_IOC_SET_FORMAT, &format) == -1)
+    {
+        perror("Error selecting the summary format");
+        close(summary_file);
+        return;
+    }
+    /* Wait up to twice the window length for the next window to complete */
+    if((ioctl(summary_file, SIMTEMP_IOC_GET_CONFIG, &config) == 0) && (config.window_ns != 0U))
+    {
+        timeout_ms = (int)((config.window_ns / 1000000ULL) * 2U) + 1;
+    }
+
+    memset(&my_poll, 0, sizeof(my_poll));
+    my_poll.fd = summary_file;
+    my_poll.events = POLLIN;
+    if((poll(&my_poll, 1, timeout_ms) > 0) && (read(summary_file, &summary, sizeof(summary)) == (ssize_t)sizeof(summary)))
+    {
+        printf("Samples in the window: %u\n", summary.count);
+        printf("Minimum temperature in mC: %d\n", summary.min_mC);
+        printf("Maximum temperature in mC: %d\n", summary.max_mC);
+        printf("Mean temperature in mC: %d\n", summary.mean_mC);
+        printf("First Sequence Number: %llu\n", (unsigned long long)summary.first_sequence);
+        print_timestamp(summary.last_timestamp_ns);
+    }
+    else
+    {
+        printf("No window was completed, check simtemp_sysfs_window_ns and simtemp_sysfs_window_samples. \n");
+    }
+    close(summary_file);
+}
+
+
+
+void daemon_stop(int signal_number)
+{
+    (void)signal_number;
+    daemon_running = 0;
+}
+
+
+
+/* Reads every pending sample of a device in batches of SAMPLE_BATCH_SIZE. At most DAEMON_MAX_READS_PER_WAKEUP
+ * batches are read so that a fast device does not starve the others, epoll reports it again if samples are left */
+void daemon_drain_samples(struct daemon_device * device)
+{
+    ssize_t bytes_read;
+    size_t number_of_samples;
+    size_t index;
+    unsigned int reads;
+
+    for(reads = 0U; reads < DAEMON_MAX_READS_PER_WAKEUP; reads++)
+    {
+        bytes_read = read(device->fd, sample_buffer, sizeof(sample_buffer));
+        if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+        {
+            if((bytes_read < 0) && (errno != EAGAIN) && (errno != EINTR))
+            {
+                fprintf(stderr, "%s: %s\n", device->path, strerror(errno));
+            }
+            break;
+        }
+        number_of_samples = (size_t)bytes_read / sizeof(struct simtemp_sample);
+        /* Detect lost samples through the gaps in the sequence numbers, a full reader buffer drops samples in
+         * the middle of a batch too */
+        if(device->next_sequence == 0U)
+        {
+            device->next_sequence = sample_buffer[0].sequence;
+        }
+        for(index = 0U; index < number_of_samples; index++)
+        {
+            if(sample_buffer[index].sequence > device->next_sequence)
+            {
+                device->lost += sample_buffer[index].sequence - device->next_sequence;
+            }
+            device->next_sequence = sample_buffer[index].sequence + 1U;
+        }
+        device->samples += number_of_samples;
+        device->last_temp_mC = sample_buffer[number_of_samples - 1U].temp_mC;
+        if(number_of_samples < SAMPLE_BATCH_SIZE)
+        {
+            break;
+        }
+    }
+}
+
+
+
+/* Fetches and prints every threshold event queued for a device */
+void daemon_drain_events(struct daemon_device * device)
+{
+    struct simtemp_event event;
+
+    while(ioctl(device->fd, SIMTEMP_IOC_GET_EVENT, &event) == 0)
+    {
+        printf("%s: %s event, %d mC crossed %d mC (sequence %llu", device->path,
+               (event.type == SIMTEMP_EVENT_RISING) ? "rising" : "falling", event.temp_mC, event.trip_mC,
+               (unsigned long long)event.sequence);
+        if(event.lost != 0U)
+        {
+            printf(", %u events lost", event.lost);
+        }
+        printf(")\n");
+    }
+}
+
+
+
+/* Non-interactive mode: watches every /dev/simtemp_devN with a single epoll instance, POLLIN for samples and
+ * POLLPRI for threshold events, and prints the aggregated rate and losses once per DAEMON_REPORT_PERIOD_MS */
+int run_daemon(void)
+{
+    struct epoll_event ready[DAEMON_MAX_EVENTS];
+    struct epoll_event registration;
+    struct daemon_device *devices;
+    struct daemon_device *device;
+    struct timespec now;
+    struct timespec last_report;
+    glob_t device_paths;
+    size_t number_of_devices = 0U;
+    size_t index;
+    unsigned long long samples;
+    unsigned long long lost;
+    double elapsed;
+    int epoll_fd;
+    int number_ready;
+    int ready_index;
+
+    if(glob(DAEMON_DEVICE_PATTERN, 0, NULL, &device_paths) != 0)
+    {
+        fprintf(stderr, "No device matches %s\n", DAEMON_DEVICE_PATTERN);
+        return EXIT_FAILURE;
+    }
+    devices = calloc(device_paths.gl_pathc, sizeof(*devices));
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if((devices == NULL) || (epoll_fd < 0))
+    {
+        perror("Could not start the daemon");
+        free(devices);
+        globfree(&device_paths);
+        return EXIT_FAILURE;
+    }
+
+    /* Open every device non-blocking and register it, level triggered so undrained devices are reported again */
+    for(index = 0U; index < device_paths.gl_pathc; index++)
+    {
+        device = &devices[number_of_devices];
+        device->fd = open(device_paths.gl_pathv[index], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if(device->fd < 0)
+        {
+            fprintf(stderr, "Could not open %s: %s\n", device_paths.gl_pathv[index], strerror(errno));
+            continue;
+        }
+        snprintf(device->path, sizeof(device->path), "%s", device_paths.gl_pathv[index]);
+        memset(&registration, 0, sizeof(registration));
+        registration.events = EPOLLIN | EPOLLPRI;
+        registration.data.ptr = device;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, device->fd, &registration) != 0)
+        {
+            fprintf(stderr, "Could not watch %s: %s\n", device->path, strerror(errno));
+            close(device->fd);
+            continue;
+        }
+        /* Alerts raised before the daemon started are not reported */
+        daemon_drain_events(device);
+        number_of_devices++;
+    }
+    globfree(&device_paths);
+    printf("Watching %zu devices, press Ctrl+C to stop\n", number_of_devices);
+
+    signal(SIGINT, daemon_stop);
+    signal(SIGTERM, daemon_stop);
+    clock_gettime(CLOCK_MONOTONIC, &last_report);
+    while(daemon_running && (number_of_devices != 0U))
+    {
+        number_ready = epoll_wait(epoll_fd, ready, DAEMON_MAX_EVENTS, DAEMON_REPORT_PERIOD_MS);
+        if((number_ready < 0) && (errno != EINTR))
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for(ready_index = 0; ready_index < number_ready; ready_index++)
+        {
+            device = ready[ready_index].data.ptr;
+            /* Alerts first, they must not wait behind a batch of samples */
+            if(ready[ready_index].events & EPOLLPRI)
+            {
+                daemon_drain_events(device);
+            }
+            if(ready[ready_index].events & EPOLLIN)
+            {
+                daemon_drain_samples(device);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (double)(now.tv_sec - last_report.tv_sec) + ((double)(now.tv_nsec - last_report.tv_nsec) / 1e9);
+        if(elapsed * 1000.0 >= DAEMON_REPORT_PERIOD_MS)
+        {
+            samples = 0U;
+            lost = 0U;
+            for(index = 0U; index < number_of_devices; index++)
+            {
+                samples += devices[index].samples;
+                lost += devices[index].lost;
+                devices[index].samples = 0U;
+            }
+            printf("%zu devices, %.0f samples/s, %llu samples lost\n", number_of_devices, (double)samples / elapsed, lost);
+            fflush(stdout);
+            last_report = now;
+        }
+    }
+
+    for(index = 0U; index < number_of_devices; index++)
+    {
+        close(devices[index].fd);
+    }
+    close(epoll_fd);
+    free(devices);
+    return EXIT_SUCCESS;
+}
+
+
+
+/* Writes the whole buffer, retrying the partial writes */
+int stream_write_all(int fd, const char * data, size_t length)
+{
+    ssize_t written;
+
+    while(length != 0U)
+    {
+        written = write(fd, data, length);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+
+
+/* Appends the decimal digits of value at text and returns the position after the last one. Used instead of
+ * snprintf() because the CSV output formats four numbers per sample */
+char * stream_format_u64(char * text, unsigned long long value)
+{
+    char digits[20];
+    unsigned int count = 0U;
+
+    do
+    {
+        digits[count++] = (char)('0' + (value % 10U));
+        value /= 10U;
+    } while(value != 0U);
+    while(count != 0U)
+    {
+        *text++ = digits[--count];
+    }
+    return text;
+}
+
+
+
+/* Appends one sample as a "sequence,timestamp_ns,temp_mC,flags" line and returns the position after it */
+char * stream_format_csv(char * text, const struct simtemp_sample * sample)
+{
+    text = stream_format_u64(text, (unsigned long long)sample->sequence);
+    *text++ = ',';
+    text = stream_format_u64(text, (unsigned long long)sample->timestamp_ns);
+    *text++ = ',';
+    if(sample->temp_mC < 0)
+    {
+        *text++ = '-';
+        text = stream_format_u64(text, (unsigned long long)(-(long long)sample->temp_mC));
+    }
+    else
+    {
+        text = stream_format_u64(text, (unsigned long long)sample->temp_mC);
+    }
+    *text++ = ',';
+    text = stream_format_u64(text, (unsigned long long)sample->flags);
+    *text++ = '\n';
+    return text;
+}
+
+
+
+/* Non-interactive capture: --stream [--device PATH] [--count N] [--format csv|bin] [--out FILE].
+ * Reads the samples in batches of up to SAMPLE_BATCH_SIZE and writes them through a STREAM_BUFFER_BYTES buffer
+ * that is flushed with a single write() when full. The binary format is the raw struct simtemp_sample records,
+ * read() places them straight into the output buffer. A count of 0 streams until SIGINT or SIGTERM. */
+int run_stream(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "stream", no_argument,       NULL, 's' },
+        { "device", required_argument, NULL, 'd' },
+        { "count",  required_argument, NULL, 'n' },
+        { "format", required_argument, NULL, 'f' },
+        { "out",    required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *device_path = STREAM_DEFAULT_DEVICE;
+    const char *out_path = NULL;
+    unsigned int format = STREAM_FORMAT_CSV;
+    unsigned long long count = 0U;
+    unsigned long long samples = 0U;
+    unsigned long long lost = 0U;
+    unsigned long long expected = 0U;
+    struct simtemp_sample *records;
+    size_t batch;
+    size_t number_of_samples;
+    size_t used = 0U;
+    size_t index;
+    ssize_t bytes_read;
+    char *buffer;
+    int out_fd = STDOUT_FILENO;
+    int status = EXIT_SUCCESS;
+    int option;
+
+    while((option = getopt_long(argc, argv, "sd:n:f:o:", options, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 's':
+                break;
+            case 'd':
+                device_path = optarg;
+                break;
+            case 'n':
+                count = strtoull(optarg, NULL, 0);
+                break;
+            case 'f':
+                if(strcmp(optarg, "csv") == 0)
+                {
+                    format = STREAM_FORMAT_CSV;
+                }
+                else if(strcmp(optarg, "bin") == 0)
+                {
+                    format = STREAM_FORMAT_BIN;
+                }
+                else
+                {
+                    fprintf(stderr, "Unknown format %s, use csv or bin\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s --stream [--device PATH] [--count N] [--format csv|bin] [--out FILE]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    deviceFile = open(device_path, O_RDONLY | O_CLOEXEC);
+    if(deviceFile < 0)
+    {
+        fprintf(stderr, "Could not open %s: %s\n", device_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(out_path != NULL)
+    {
+        out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(out_fd < 0)
+        {
+            fprintf(stderr, "Could not open %s: %s\n", out_path, strerror(errno));
+            close(deviceFile);
+            return EXIT_FAILURE;
+        }
+    }
+    buffer = malloc(STREAM_BUFFER_BYTES);
+    if(buffer == NULL)
+    {
+        perror("Could not allocate the output buffer");
+        close(deviceFile);
+        if(out_fd != STDOUT_FILENO)
+        {
+            close(out_fd);
+        }
+        return EXIT_FAILURE;
+    }
+    if(format == STREAM_FORMAT_CSV)
+    {
+        used = (size_t)sprintf(buffer, "sequence,timestamp_ns,temp_mC,flags\n");
+    }
+
+    signal(SIGINT, daemon_stop);
+    signal(SIGTERM, daemon_stop);
+    while(daemon_running && ((count == 0U) || (samples < count)))
+    {
+        batch = SAMPLE_BATCH_SIZE;
+        if((count != 0U) && ((count - samples) < batch))
+        {
+            batch = (size_t)(count - samples);
+        }
+        /* Flush first if the next batch may not fit */
+        if((used + (batch * ((format == STREAM_FORMAT_BIN) ? sizeof(struct simtemp_sample) : STREAM_CSV_LINE_MAX))) > STREAM_BUFFER_BYTES)
+        {
+            if(stream_write_all(out_fd, buffer, used) != 0)
+            {
+                perror("Error writing the samples");
+                status = EXIT_FAILURE;
+                break;
+            }
+            used = 0U;
+        }
+
+        /* Binary records land in the output buffer directly, CSV goes through sample_buffer and is formatted */
+        records = (format == STREAM_FORMAT_BIN) ? (struct simtemp_sample *)(void *)(buffer + used) : sample_buffer;
+        bytes_read = read(deviceFile, records, batch * sizeof(struct simtemp_sample));
+        if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+        {
+            if((bytes_read < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            fprintf(stderr, "Error reading %s: %s\n", device_path, (bytes_read < 0) ? strerror(errno) : "short read");
+            status = EXIT_FAILURE;
+            break;
+        }
+        number_of_samples = (size_t)bytes_read / sizeof(struct simtemp_sample);
+
+        /* Detect lost samples through the gaps in the sequence numbers, a full reader buffer drops samples in
+         * the middle of a batch too */
+        if(samples == 0U)
+        {
+            expected = records[0].sequence;
+        }
+        for(index = 0U; index < number_of_samples; index++)
+        {
+            if(records[index].sequence > expected)
+            {
+                lost += records[index].sequence - expected;
+            }
+            expected = records[index].sequence + 1U;
+        }
+        samples += number_of_samples;
+
+        if(format == STREAM_FORMAT_BIN)
+        {
+            used += number_of_samples * sizeof(struct simtemp_sample);
+        }
+        else
+        {
+            for(index = 0U; index < number_of_samples; index++)
+            {
+                used = (size_t)(stream_format_csv(buffer + used, &records[index]) - buffer);
+            }
+        }
+    }
+    if((used != 0U) && (stream_write_all(out_fd, buffer, used) != 0))
+    {
+        perror("Error writing the samples");
+        status = EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%llu samples written, %llu samples lost\n", samples, lost);
+    free(buffer);
+    close(deviceFile);
+    if((out_fd != STDOUT_FILENO) && (close(out_fd) != 0))
+    {
+        perror("Error closing the output file");
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+
+
+/* Non-interactive capture into a block indexed file: --record --out FILE [--device PATH] [--count N].
+ * Same read loop as --stream, the samples are handed to the recorder which encodes and writes one block every
+ * SIMREC_BLOCK_SAMPLES samples and the index when the capture ends, see recorder.h. A count of 0 records until
+ * SIGINT or SIGTERM. */
+int run_record(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "record", no_argument,       NULL, 'r' },
+        { "device", required_argument, NULL, 'd' },
+        { "count",  required_argument, NULL, 'n' },
+        { "out",    required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *device_path = STREAM_DEFAULT_DEVICE;
+    const char *out_path = NULL;
+    unsigned long long count = 0U;
+    unsigned long long samples = 0U;
+    unsigned long long lost = 0U;
+    unsigned long long expected = 0U;
+    struct simrec_writer *writer;
+    size_t batch;
+    size_t number_of_samples;
+    size_t index;
+    ssize_t bytes_read;
+    int status = EXIT_SUCCESS;
+    int option;
+
+    while((option = getopt_long(argc, argv, "rd:n:o:", options, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'r':
+                break;
+            case 'd':
+                device_path = optarg;
+                break;
+            case 'n':
+                count = strtoull(optarg, NULL, 0);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                out_path = NULL;
+                optind = argc;
+                break;
+        }
+    }
+    if(out_path == NULL)
+    {
+        fprintf(stderr, "Usage: %s --record --out FILE [--device PATH] [--count N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    deviceFile = open(device_path, O_RDONLY | O_CLOEXEC);
+    if(deviceFile < 0)
+    {
+        fprintf(stderr, "Could not open %s: %s\n", device_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    writer = simrec_create(out_path);
+    if(writer == NULL)
+    {
+        fprintf(stderr, "Could not create %s: %s\n", out_path, strerror(errno));
+        close(deviceFile);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, daemon_stop);
+    signal(SIGTERM, daemon_stop);
+    while(daemon_running && ((count == 0U) || (samples < count)))
+    {
+        batch = SAMPLE_BATCH_SIZE;
+        if((count != 0U) && ((count - samples) < batch))
+        {
+            batch = (size_t)(count - samples);
+        }
+        bytes_read = read(deviceFile, sample_buffer, batch * sizeof(struct simtemp_sample));
+        if(bytes_read < (ssize_t)sizeof(struct simtemp_sample))
+        {
+            if((bytes_read < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            fprintf(stderr, "Error reading %s: %s\n", device_path, (bytes_read < 0) ? strerror(errno) : "short read");
+            status = EXIT_FAILURE;
+            break;
+        }
+        number_of_samples = (size_t)bytes_read / sizeof(struct simtemp_sample);
+
+        if(samples == 0U)
+        {
+            expected = sample_buffer[0].sequence;
+        }
+        for(index = 0U; index < number_of_samples; index++)
+        {
+            if(sample_buffer[index].sequence > expected)
+            {
+                lost += sample_buffer[index].sequence - expected;
+            }
+            expected = sample_buffer[index].sequence + 1U;
+        }
+        samples += number_of_samples;
+
+        if(simrec_append(writer, sample_buffer, number_of_samples) != 0)
+        {
+            perror("Error writing the samples");
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+    /* Whatever was recorded is closed with its index, even after an error */
+    if(simrec_finish(writer) != 0)
+    {
+        perror("Error finishing the capture file");
+        status = EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "%llu samples recorded, %llu samples lost\n", samples, lost);
+    close(deviceFile);
+    return status;
+}
+
+
+
+/* Queries a file written by --record: --query FILE [--from NS] [--to NS] [--above MC] [--out FILE].
+ * Prints as CSV the samples with from <= timestamp_ns <= to and, with --above, temp_mC > MC. The index at the end
+ * of the mapped file is checked first and only the blocks whose time and temperature ranges can hold a match are
+ * decoded, the number of blocks decoded is reported on stderr. */
+int run_query(int argc, char *argv[])
+{
+    static const struct option options[] = {
+        { "query", required_argument, NULL, 'q' },
+        { "from",  required_argument, NULL, 'f' },
+        { "to",    required_argument, NULL, 't' },
+        { "above", required_argument, NULL, 'a' },
+        { "out",   required_argument, NULL, 'o' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct simrec_index_entry entry;
+    const struct simtemp_sample *sample;
+    struct simtemp_sample *samples;
+    struct simrec_reader reader;
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    unsigned long long from = 0U;
+    unsigned long long to = UINT64_MAX;
+    unsigned long long matches = 0U;
+    long long above = INT64_MIN;
+    uint32_t blocks_decoded = 0U;
+    uint32_t block;
+    char *buffer;
+    char *text;
+    int number_of_samples;
+    int index;
+    int out_fd = STDOUT_FILENO;
+    int status = EXIT_SUCCESS;
+    int option;
+
+    while((option = getopt_long(argc, argv, "q:f:t:a:o:", options, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'q':
+                in_path = optarg;
+                break;
+            case 'f':
+                from = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                to = strtoull(optarg, NULL, 0);
+                break;
+            case 'a':
+                above = strtoll(optarg, NULL, 0);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                in_path = NULL;
+                optind = argc;
+                break;
+        }
+    }
+    if(in_path == NULL)
+    {
+        fprintf(stderr, "Usage: %s --query FILE [--from NS] [--to NS] [--above MC] [--out FILE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(simrec_map(&reader, in_path) != 0)
+    {
+        fprintf(stderr, "Could not map %s: %s\n", in_path, (errno == EINVAL) ? "not a complete capture file" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(out_path != NULL)
+    {
+        out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(out_fd < 0)
+        {
+            fprintf(stderr, "Could not open %s: %s\n", out_path, strerror(errno));
+            simrec_unmap(&reader);
+            return EXIT_FAILURE;
+        }
+    }
+    samples = malloc(SIMREC_BLOCK_SAMPLES * sizeof(*samples));
+    buffer = malloc(QUERY_CSV_BUFFER_BYTES);
+    if((samples == NULL) || (buffer == NULL))
+    {
+        perror("Could not allocate the query buffers");
+        status = EXIT_FAILURE;
+    }
+
+    if((status == EXIT_SUCCESS) && (stream_write_all(out_fd, "sequence,timestamp_ns,temp_mC,flags\n", 36U) != 0))
+    {
+        perror("Error writing the samples");
+        status = EXIT_FAILURE;
+    }
+    for(block = 0U; (status == EXIT_SUCCESS) && (block < reader.blocks); block++)
+    {
+        /* Skip the block without touching its columns when its ranges rule out every sample */
+        simrec_index_get(&reader, block, &entry);
+        if((entry.max_timestamp_ns < from) || (entry.min_timestamp_ns > to) || ((long long)entry.max_temp_mC <= above))
+        {
+            continue;
+        }
+        number_of_samples = simrec_decode_block(&reader, block, samples);
+        if(number_of_samples < 0)
+        {
+            fprintf(stderr, "Block %u of %s is corrupted\n", (unsigned int)block, in_path);
+            status = EXIT_FAILURE;
+            break;
+        }
+        blocks_decoded++;
+
+        text = buffer;
+        for(index = 0; index < number_of_samples; index++)
+        {
+            sample = &samples[index];
+            if((sample->timestamp_ns >= from) && (sample->timestamp_ns <= to) && ((long long)sample->temp_mC > above))
+            {
+                text = stream_format_csv(text, sample);
+                matches++;
+            }
+        }
+        if(stream_write_all(out_fd, buffer, (size_t)(text - buffer)) != 0)
+        {
+            perror("Error writing the samples");
+            status = EXIT_FAILURE;
+        }
+    }
+
+    fprintf(stderr, "%llu samples matched, %u of %u blocks decoded\n", matches, (unsigned int)blocks_decoded, (unsigned int)reader.blocks);
+    free(buffer);
+    free(samples);
+    simrec_unmap(&reader);
+    if((out_fd != STDOUT_FILENO) && (close(out_fd) != 0))
+    {
+        perror("Error closing the output file");
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+
+
+int main(int argc, char *argv[])
 {
     /* Variable to interact with the menu */
     int selectedOption = 0;
 
+    /* Non-interactive monitoring of every device */
+    if((argc > 1) && (strcmp(argv[1], "--daemon") == 0))
+    {
+        return run_daemon();
+    }
+
+    /* Non-interactive capture of one device */
+    if((argc > 1) && (strcmp(argv[1], "--stream") == 0))
+    {
+        return run_stream(argc, argv);
+    }
+
+    /* Capture of one device into a block indexed file, and queries over such a file */
+    if((argc > 1) && (strcmp(argv[1], "--record") == 0))
+    {
+        return run_record(argc, argv);
+    }
+    if((argc > 1) && (strcmp(argv[1], "--query") == 0))
+    {
+        return run_query(argc, argv);
+    }
+
     /* Open the Device file*/
     deviceFile = open("/dev/simtemp_dev0", O_RDONLY);
     if(deviceFile < 0)
@@ -309,15 +1139,15 @@ int main()
             switch(selectedOption)
             {
                 case MENU_CONF_PERIOD:
-                    write_sysfs_file_integer_value("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_sampling_time", "Enter the Sampling time in ms:  ");
+                    write_config_value(SIMTEMP_CFG_SAMPLING_TIME, "Enter the Sampling time in ms:  ");
                     break;
 
                 case MENU_CONF_THRES:
-                    write_sysfs_file_integer_value("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_temperature_threshold", "Enter the threshold in mC:  ");  
+                    write_config_value(SIMTEMP_CFG_THRESHOLD, "Enter the threshold in mC:  ");
                     break;
 
                 case MENU_CONF_MODE:
-                    write_sysfs_file_integer_value("/sys/class/simtemp_class/simtemp_dev0/simtemp_sysfs_mode", "Enter the temperature mode, 0-Normal, 1-Noisy, 2-Ramp:  ");
+                    write_config_value(SIMTEMP_CFG_MODE, "Enter the temperature mode, 0-Normal, 1-Noisy, 2-Ramp, 3-Sine, 4-Square, 5-Replay:  ");
                     break;
 
                 case MENU_READ_TEMP:
@@ -336,6 +1166,10 @@ int main()
                 enter_test_mode();
                     break;
 
+                case MENU_READ_SUMMARY:
+                    read_temperature_summary();
+                    break;
+
                 default:
                     printf("An incorrect option was selected. Try again...\n");
                     break;
@@ -0,0 +1,451 @@
+/**
+ * @file recorder.c
+ * @brief Block structured capture files of simtemp samples, see recorder.h for the layout.
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+
+/******************/
+/**** Includes ****/
+/******************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "recorder.h"
+
+
+
+/*****************************/
+/**** Struct definitions *****/
+/*****************************/
+struct simrec_writer {
+    int fd;
+    uint64_t offset;                                   /* Bytes written so far */
+    uint32_t count;                                    /* Samples in block */
+    struct simtemp_sample block[SIMREC_BLOCK_SAMPLES]; /* Block being filled */
+    unsigned char columns[4][SIMREC_BLOCK_SAMPLES * 10U]; /* Encoded columns of the block, 10 bytes per varint at most */
+    struct simrec_index_entry *index;
+    uint32_t blocks;
+    uint32_t index_capacity;
+};
+
+
+
+/****************************/
+/**** Helper functions ******/
+/****************************/
+static size_t simrec_put_varint(unsigned char *out, uint64_t value)
+{
+    size_t length = 0U;
+
+    while(value >= 0x80U)
+    {
+        out[length++] = (unsigned char)(value | 0x80U);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+/* @brief Reads the varint at *position, -1 if it runs past end */
+static int simrec_get_varint(const unsigned char **position, const unsigned char *end, uint64_t *value)
+{
+    const unsigned char *cursor = *position;
+    uint64_t result = 0U;
+    unsigned int shift = 0U;
+
+    while((cursor < end) && (shift < 64U))
+    {
+        result |= (uint64_t)(*cursor & 0x7FU) << shift;
+        if((*cursor++ & 0x80U) == 0U)
+        {
+            *position = cursor;
+            *value = result;
+            return 0;
+        }
+        shift += 7U;
+    }
+    return -1;
+}
+
+static uint64_t simrec_zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t simrec_unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1U);
+}
+
+static int simrec_write_all(int fd, const void *data, size_t length)
+{
+    const char *cursor = data;
+    ssize_t written;
+
+    while(length != 0U)
+    {
+        written = write(fd, cursor, length);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        cursor += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+
+
+/* @brief Encodes the block being filled, writes its columns and footer and adds it to the index */
+static int simrec_flush_block(struct simrec_writer *writer)
+{
+    struct simrec_block_footer footer;
+    struct simrec_index_entry *entry;
+    const struct simtemp_sample *previous;
+    const struct simtemp_sample *sample;
+    size_t lengths[4] = { 0U, 0U, 0U, 0U };
+    uint32_t index;
+    uint32_t column;
+
+    if(writer->count == 0U)
+    {
+        return 0;
+    }
+    if(writer->blocks == writer->index_capacity)
+    {
+        entry = realloc(writer->index, (writer->index_capacity + 256U) * sizeof(*entry));
+        if(entry == NULL)
+        {
+            return -1;
+        }
+        writer->index = entry;
+        writer->index_capacity += 256U;
+    }
+
+    memset(&footer, 0, sizeof(footer));
+    footer.magic = SIMREC_BLOCK_MAGIC;
+    footer.count = writer->count;
+    footer.first_timestamp_ns = writer->block[0].timestamp_ns;
+    footer.first_sequence = writer->block[0].sequence;
+    footer.first_temp_mC = writer->block[0].temp_mC;
+    footer.min_temp_mC = writer->block[0].temp_mC;
+    footer.max_temp_mC = writer->block[0].temp_mC;
+    footer.min_timestamp_ns = writer->block[0].timestamp_ns;
+    footer.max_timestamp_ns = writer->block[0].timestamp_ns;
+    previous = &writer->block[0];
+    for(index = 0U; index < writer->count; index++)
+    {
+        sample = &writer->block[index];
+        lengths[0] += simrec_put_varint(&writer->columns[0][lengths[0]], simrec_zigzag((int64_t)(sample->timestamp_ns - previous->timestamp_ns)));
+        lengths[1] += simrec_put_varint(&writer->columns[1][lengths[1]], simrec_zigzag((int64_t)(sample->sequence - previous->sequence)));
+        lengths[2] += simrec_put_varint(&writer->columns[2][lengths[2]], simrec_zigzag((int64_t)sample->temp_mC - previous->temp_mC));
+        lengths[3] += simrec_put_varint(&writer->columns[3][lengths[3]], sample->flags);
+        if(sample->temp_mC < footer.min_temp_mC)
+        {
+            footer.min_temp_mC = sample->temp_mC;
+        }
+        if(sample->temp_mC > footer.max_temp_mC)
+        {
+            footer.max_temp_mC = sample->temp_mC;
+        }
+        if(sample->timestamp_ns < footer.min_timestamp_ns)
+        {
+            footer.min_timestamp_ns = sample->timestamp_ns;
+        }
+        if(sample->timestamp_ns > footer.max_timestamp_ns)
+        {
+            footer.max_timestamp_ns = sample->timestamp_ns;
+        }
+        previous = sample;
+    }
+    footer.timestamp_bytes = (uint32_t)lengths[0];
+    footer.sequence_bytes = (uint32_t)lengths[1];
+    footer.temp_bytes = (uint32_t)lengths[2];
+    footer.flags_bytes = (uint32_t)lengths[3];
+
+    for(column = 0U; column < 4U; column++)
+    {
+        if(simrec_write_all(writer->fd, writer->columns[column], lengths[column]) != 0)
+        {
+            return -1;
+        }
+    }
+    if(simrec_write_all(writer->fd, &footer, sizeof(footer)) != 0)
+    {
+        return -1;
+    }
+
+    entry = &writer->index[writer->blocks++];
+    entry->offset = writer->offset;
+    entry->min_timestamp_ns = footer.min_timestamp_ns;
+    entry->max_timestamp_ns = footer.max_timestamp_ns;
+    entry->min_temp_mC = footer.min_temp_mC;
+    entry->max_temp_mC = footer.max_temp_mC;
+    entry->count = footer.count;
+    entry->size = (uint32_t)(lengths[0] + lengths[1] + lengths[2] + lengths[3] + sizeof(footer));
+    writer->offset += entry->size;
+    writer->count = 0U;
+    return 0;
+}
+
+
+
+/****************************/
+/**** Writer ****************/
+/****************************/
+/* @brief Creates or truncates path and writes the file header. Returns NULL with errno set on error */
+struct simrec_writer *simrec_create(const char *path)
+{
+    struct simrec_file_header header;
+    struct simrec_writer *writer;
+    int saved_errno;
+
+    writer = calloc(1U, sizeof(*writer));
+    if(writer == NULL)
+    {
+        return NULL;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(writer->fd < 0)
+    {
+        free(writer);
+        return NULL;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = SIMREC_MAGIC;
+    header.version = SIMREC_VERSION;
+    header.block_samples = SIMREC_BLOCK_SAMPLES;
+    if(simrec_write_all(writer->fd, &header, sizeof(header)) != 0)
+    {
+        saved_errno = errno;
+        close(writer->fd);
+        free(writer);
+        errno = saved_errno;
+        return NULL;
+    }
+    writer->offset = sizeof(header);
+    return writer;
+}
+
+
+
+/* @brief Adds samples to the file, a block is encoded and written every SIMREC_BLOCK_SAMPLES samples */
+int simrec_append(struct simrec_writer *writer, const struct simtemp_sample *samples, size_t count)
+{
+    size_t chunk;
+
+    while(count != 0U)
+    {
+        chunk = SIMREC_BLOCK_SAMPLES - writer->count;
+        if(chunk > count)
+        {
+            chunk = count;
+        }
+        memcpy(&writer->block[writer->count], samples, chunk * sizeof(*samples));
+        writer->count += (uint32_t)chunk;
+        samples += chunk;
+        count -= chunk;
+        if((writer->count == SIMREC_BLOCK_SAMPLES) && (simrec_flush_block(writer) != 0))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+/* @brief Writes the last block, the index and the trailer, closes the file and releases the writer.
+ *        The writer is released even on error.
+ */
+int simrec_finish(struct simrec_writer *writer)
+{
+    struct simrec_trailer trailer;
+    int status = 0;
+    int saved_errno = 0;
+
+    if(simrec_flush_block(writer) != 0)
+    {
+        status = -1;
+    }
+    if(status == 0)
+    {
+        trailer.index_offset = writer->offset;
+        trailer.blocks = writer->blocks;
+        trailer.magic = SIMREC_INDEX_MAGIC;
+        if((simrec_write_all(writer->fd, writer->index, writer->blocks * sizeof(*writer->index)) != 0) ||
+           (simrec_write_all(writer->fd, &trailer, sizeof(trailer)) != 0))
+        {
+            status = -1;
+        }
+    }
+    if(status != 0)
+    {
+        saved_errno = errno;
+    }
+    if((close(writer->fd) != 0) && (status == 0))
+    {
+        status = -1;
+        saved_errno = errno;
+    }
+    free(writer->index);
+    free(writer);
+    if(status != 0)
+    {
+        errno = saved_errno;
+    }
+    return status;
+}
+
+
+
+/****************************/
+/**** Reader ****************/
+/****************************/
+/* @brief Maps a capture file read-only and checks its header, trailer and index. -1 with errno set on error,
+ *        EINVAL when the file is not a complete capture
+ */
+int simrec_map(struct simrec_reader *reader, const char *path)
+{
+    struct simrec_file_header header;
+    struct simrec_trailer trailer;
+    struct stat status;
+    void *map;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if(fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if((size_t)status.st_size < (sizeof(header) + sizeof(trailer)))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return -1;
+    }
+    reader->map = map;
+    reader->size = (size_t)status.st_size;
+
+    /* The blocks have any length, so nothing after them is aligned: the structures are copied out of the map */
+    memcpy(&header, reader->map, sizeof(header));
+    memcpy(&trailer, reader->map + reader->size - sizeof(trailer), sizeof(trailer));
+    if((header.magic != SIMREC_MAGIC) || (header.version != SIMREC_VERSION) || (trailer.magic != SIMREC_INDEX_MAGIC) ||
+       (trailer.index_offset > (reader->size - sizeof(trailer))) ||
+       (trailer.blocks > ((reader->size - sizeof(trailer) - trailer.index_offset) / sizeof(struct simrec_index_entry))))
+    {
+        simrec_unmap(reader);
+        errno = EINVAL;
+        return -1;
+    }
+    reader->index = reader->map + trailer.index_offset;
+    reader->blocks = trailer.blocks;
+    return 0;
+}
+
+
+
+void simrec_unmap(struct simrec_reader *reader)
+{
+    if(reader->map != NULL)
+    {
+        munmap((void *)reader->map, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+
+
+/* @brief Copies the index entry of block number block, which must be lower than reader->blocks */
+void simrec_index_get(const struct simrec_reader *reader, uint32_t block, struct simrec_index_entry *entry)
+{
+    memcpy(entry, reader->index + ((size_t)block * sizeof(*entry)), sizeof(*entry));
+}
+
+
+
+/* @brief Decodes block number block into samples, which must hold SIMREC_BLOCK_SAMPLES records.
+ *        Returns the number of samples or -1 with errno set to EINVAL if the block is corrupted.
+ */
+int simrec_decode_block(const struct simrec_reader *reader, uint32_t block, struct simtemp_sample *samples)
+{
+    struct simrec_index_entry entry;
+    struct simrec_block_footer footer;
+    const unsigned char *columns[4];
+    const unsigned char *ends[4];
+    struct simtemp_sample previous;
+    uint64_t values[4];
+    uint32_t index;
+    uint32_t column;
+
+    if(block >= reader->blocks)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    simrec_index_get(reader, block, &entry);
+    if((entry.size < sizeof(footer)) || (entry.offset > reader->size) || (entry.size > (reader->size - entry.offset)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&footer, reader->map + entry.offset + entry.size - sizeof(footer), sizeof(footer));
+    if((footer.magic != SIMREC_BLOCK_MAGIC) || (footer.count > SIMREC_BLOCK_SAMPLES) ||
+       (((uint64_t)footer.timestamp_bytes + footer.sequence_bytes + footer.temp_bytes + footer.flags_bytes + sizeof(footer)) != entry.size))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    columns[0] = reader->map + entry.offset;
+    ends[0] = columns[0] + footer.timestamp_bytes;
+    columns[1] = ends[0];
+    ends[1] = columns[1] + footer.sequence_bytes;
+    columns[2] = ends[1];
+    ends[2] = columns[2] + footer.temp_bytes;
+    columns[3] = ends[2];
+    ends[3] = columns[3] + footer.flags_bytes;
+
+    previous.timestamp_ns = footer.first_timestamp_ns;
+    previous.sequence = footer.first_sequence;
+    previous.temp_mC = footer.first_temp_mC;
+    previous.flags = 0U;
+    for(index = 0U; index < footer.count; index++)
+    {
+        for(column = 0U; column < 4U; column++)
+        {
+            if(simrec_get_varint(&columns[column], ends[column], &values[column]) != 0)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+        samples[index].timestamp_ns = previous.timestamp_ns + (uint64_t)simrec_unzigzag(values[0]);
+        samples[index].sequence = previous.sequence + (uint64_t)simrec_unzigzag(values[1]);
+        samples[index].temp_mC = (int32_t)(previous.temp_mC + simrec_unzigzag(values[2]));
+        samples[index].flags = (uint32_t)values[3];
+        previous = samples[index];
+    }
+    return (int)footer.count;
+}
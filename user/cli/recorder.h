@@ -0,0 +1,115 @@
+/**
+ * @file recorder.h
+ * @brief Block structured capture files of simtemp samples (.simrec).
+ *
+ *        Layout, every integer in host byte order:
+ *
+ *            struct simrec_file_header
+ *            block 0: columns, struct simrec_block_footer
+ *            block 1: columns, struct simrec_block_footer
+ *            ...
+ *            struct simrec_index_entry[blocks]
+ *            struct simrec_trailer
+ *
+ *        A block holds up to SIMREC_BLOCK_SAMPLES samples stored as four columns of varints, one value per
+ *        sample: timestamp, sequence and temperature as zig-zag deltas from the previous sample of the block
+ *        (the first one from the first_* fields of the footer, so its delta is 0), and the flags as they are.
+ *        The footer has the length of every column and the time and temperature range of the block, and the
+ *        index at the end of the file repeats those ranges with the offset of every block. A reader maps the
+ *        file, walks the index and only decodes the blocks that can match a query.
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+#ifndef RECORDER_H
+#define RECORDER_H
+
+/******************/
+/**** Includes ****/
+/******************/
+#include <stddef.h>
+#include <stdint.h>
+#include "../../kernel/nxp_simtemp.h"
+
+
+
+/****************************/
+/**** Macro definitions *****/
+/****************************/
+#define SIMREC_MAGIC                 0x43455253U /* "SREC" */
+#define SIMREC_BLOCK_MAGIC           0x4B4C4253U /* "SBLK" */
+#define SIMREC_INDEX_MAGIC           0x58444953U /* "SIDX" */
+#define SIMREC_VERSION               1U
+#define SIMREC_BLOCK_SAMPLES         4096U
+
+
+
+/*****************************/
+/**** Struct definitions *****/
+/*****************************/
+struct simrec_file_header {
+    uint32_t magic;          /* SIMREC_MAGIC */
+    uint32_t version;        /* SIMREC_VERSION */
+    uint32_t block_samples;  /* Largest number of samples of a block */
+    uint32_t reserved[5];
+};
+
+struct simrec_block_footer {
+    uint32_t magic;             /* SIMREC_BLOCK_MAGIC */
+    uint32_t count;             /* Samples in the block */
+    uint32_t timestamp_bytes;   /* Length of every column, they are stored in this order before the footer */
+    uint32_t sequence_bytes;
+    uint32_t temp_bytes;
+    uint32_t flags_bytes;
+    uint64_t first_timestamp_ns;
+    uint64_t first_sequence;
+    int32_t first_temp_mC;
+    int32_t min_temp_mC;
+    int32_t max_temp_mC;
+    uint32_t reserved;
+    uint64_t min_timestamp_ns;
+    uint64_t max_timestamp_ns;
+};
+
+struct simrec_index_entry {
+    uint64_t offset;            /* File offset of the first column of the block */
+    uint64_t min_timestamp_ns;
+    uint64_t max_timestamp_ns;
+    int32_t min_temp_mC;
+    int32_t max_temp_mC;
+    uint32_t count;
+    uint32_t size;              /* Columns and footer */
+};
+
+struct simrec_trailer {
+    uint64_t index_offset;
+    uint32_t blocks;
+    uint32_t magic;             /* SIMREC_INDEX_MAGIC */
+};
+
+/* @brief Capture file being written, see simrec_create() */
+struct simrec_writer;
+
+/* @brief Capture file mapped for queries, see simrec_map() */
+struct simrec_reader {
+    const unsigned char *map;
+    size_t size;
+    const unsigned char *index; /* struct simrec_index_entry[blocks], not aligned, read with simrec_index_get() */
+    uint32_t blocks;
+};
+
+
+
+/****************************/
+/**** Function prototypes ***/
+/****************************/
+/* Writer, the functions return 0 or -1 with errno set */
+struct simrec_writer *simrec_create(const char *path);
+int simrec_append(struct simrec_writer *writer, const struct simtemp_sample *samples, size_t count);
+int simrec_finish(struct simrec_writer *writer);
+/* Reader */
+int simrec_map(struct simrec_reader *reader, const char *path);
+void simrec_unmap(struct simrec_reader *reader);
+void simrec_index_get(const struct simrec_reader *reader, uint32_t block, struct simrec_index_entry *entry);
+int simrec_decode_block(const struct simrec_reader *reader, uint32_t block, struct simtemp_sample *samples);
+
+#endif /* RECORDER_H */
@@ -0,0 +1,531 @@
+/**
+ * @file simtemp.cpp
+ * @brief libsimtemp, C++ client of /dev/simtemp_devN. See simtemp.hpp.
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+
+/******************/
+/**** Includes ****/
+/******************/
+#include "simtemp.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+
+namespace simtemp {
+
+namespace {
+
+/****************************/
+/**** Helper functions ******/
+/****************************/
+[[noreturn]] void throw_errno(const char *what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+/* @brief ioctl() that retries on EINTR and throws on any other error */
+void checked_ioctl(int fd, unsigned long request, void *arg, const char *what)
+{
+    while(::ioctl(fd, request, arg) == -1)
+    {
+        if(errno != EINTR)
+        {
+            throw_errno(what);
+        }
+    }
+}
+
+int open_device(const char *path, Device::Blocking blocking)
+{
+    int flags = O_RDONLY | O_CLOEXEC;
+    int fd;
+
+    if(blocking == Device::Blocking::No)
+    {
+        flags |= O_NONBLOCK;
+    }
+    fd = ::open(path, flags);
+    if(fd < 0)
+    {
+        throw_errno(path);
+    }
+    return fd;
+}
+
+/* @brief Reads the LEB128 varint at bytes[*position], false if it does not end before bytes.size() */
+bool get_varint(std::span<const std::uint8_t> bytes, std::size_t *position, std::uint64_t *value)
+{
+    std::uint64_t result = 0U;
+    unsigned int shift = 0U;
+    std::size_t index = *position;
+
+    while((index < bytes.size()) && (shift < 64U))
+    {
+        result |= static_cast<std::uint64_t>(bytes[index] & 0x7FU) << shift;
+        if((bytes[index++] & 0x80U) == 0U)
+        {
+            *position = index;
+            *value = result;
+            return true;
+        }
+        shift += 7U;
+    }
+    return false;
+}
+
+std::int64_t unzigzag(std::uint64_t value)
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1U);
+}
+
+/* @brief Converts the driver configuration into a Config with every field set */
+Config from_driver(const simtemp_config &raw)
+{
+    Config config;
+
+    config.sampling_period = std::chrono::nanoseconds(raw.sampling_period_ns);
+    config.threshold_mC = raw.threshold_mC;
+    config.hysteresis_mC = raw.hysteresis_mC;
+    config.mode = static_cast<Mode>(raw.mode);
+    config.clock = static_cast<Clock>(raw.clock);
+    config.window_samples = raw.window_samples;
+    config.window = std::chrono::nanoseconds(raw.window_ns);
+    return config;
+}
+
+} /* namespace */
+
+
+
+/****************************/
+/**** Device ****************/
+/****************************/
+Device::Device(const std::string &path, Blocking blocking) : fd_(open_device(path.c_str(), blocking))
+{
+}
+
+Device::Device(unsigned int index, Blocking blocking) : fd_(-1)
+{
+    char path[32];
+
+    std::snprintf(path, sizeof(path), "/dev/simtemp_dev%u", index);
+    fd_ = open_device(path, blocking);
+}
+
+Device::Device(Device &&other) noexcept : fd_(std::exchange(other.fd_, -1))
+{
+}
+
+Device &Device::operator=(Device &&other) noexcept
+{
+    if(this != &other)
+    {
+        if(fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+        fd_ = std::exchange(other.fd_, -1);
+    }
+    return *this;
+}
+
+Device::~Device()
+{
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+
+
+/* @brief Builds the mask from the fields that hold a value, the driver rejects the whole call if one is invalid */
+void Device::apply(const Config &config) const
+{
+    simtemp_config raw;
+
+    std::memset(&raw, 0, sizeof(raw));
+    raw.version = SIMTEMP_CONFIG_VERSION;
+    if(config.sampling_period)
+    {
+        raw.mask |= SIMTEMP_CFG_SAMPLING_PERIOD;
+        raw.sampling_period_ns = static_cast<__u64>(config.sampling_period->count());
+    }
+    if(config.threshold_mC)
+    {
+        raw.mask |= SIMTEMP_CFG_THRESHOLD;
+        raw.threshold_mC = *config.threshold_mC;
+    }
+    if(config.hysteresis_mC)
+    {
+        raw.mask |= SIMTEMP_CFG_HYSTERESIS;
+        raw.hysteresis_mC = *config.hysteresis_mC;
+    }
+    if(config.mode)
+    {
+        raw.mask |= SIMTEMP_CFG_MODE;
+        raw.mode = static_cast<__u32>(*config.mode);
+    }
+    if(config.clock)
+    {
+        raw.mask |= SIMTEMP_CFG_CLOCK;
+        raw.clock = static_cast<__u32>(*config.clock);
+    }
+    if(config.window_samples)
+    {
+        raw.mask |= SIMTEMP_CFG_WINDOW_SAMPLES;
+        raw.window_samples = *config.window_samples;
+    }
+    if(config.window)
+    {
+        raw.mask |= SIMTEMP_CFG_WINDOW_NS;
+        raw.window_ns = static_cast<__u64>(config.window->count());
+    }
+    checked_ioctl(fd_, SIMTEMP_IOC_SET_CONFIG, &raw, "SIMTEMP_IOC_SET_CONFIG");
+}
+
+Config Device::config() const
+{
+    simtemp_config raw;
+
+    std::memset(&raw, 0, sizeof(raw));
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_CONFIG, &raw, "SIMTEMP_IOC_GET_CONFIG");
+    return from_driver(raw);
+}
+
+Snapshot Device::snapshot() const
+{
+    simtemp_snapshot raw;
+
+    std::memset(&raw, 0, sizeof(raw));
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_SNAPSHOT, &raw, "SIMTEMP_IOC_GET_SNAPSHOT");
+    return Snapshot{raw.sample, raw.flags, from_driver(raw.config)};
+}
+
+void Device::set_waveform(const Waveform &waveform) const
+{
+    Waveform copy = waveform;
+
+    checked_ioctl(fd_, SIMTEMP_IOC_SET_WAVEFORM, &copy, "SIMTEMP_IOC_SET_WAVEFORM");
+}
+
+Waveform Device::waveform() const
+{
+    Waveform waveform;
+
+    std::memset(&waveform, 0, sizeof(waveform));
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_WAVEFORM, &waveform, "SIMTEMP_IOC_GET_WAVEFORM");
+    return waveform;
+}
+
+void Device::set_chain(const FilterChain &chain) const
+{
+    FilterChain copy = chain;
+
+    checked_ioctl(fd_, SIMTEMP_IOC_SET_CHAIN, &copy, "SIMTEMP_IOC_SET_CHAIN");
+}
+
+FilterChain Device::chain() const
+{
+    FilterChain chain;
+
+    std::memset(&chain, 0, sizeof(chain));
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_CHAIN, &chain, "SIMTEMP_IOC_GET_CHAIN");
+    return chain;
+}
+
+
+
+void Device::set_format(Format format) const
+{
+    __u32 raw = static_cast<__u32>(format);
+
+    checked_ioctl(fd_, SIMTEMP_IOC_SET_FORMAT, &raw, "SIMTEMP_IOC_SET_FORMAT");
+}
+
+Format Device::format() const
+{
+    __u32 raw = 0U;
+
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_FORMAT, &raw, "SIMTEMP_IOC_GET_FORMAT");
+    return static_cast<Format>(raw);
+}
+
+std::size_t Device::read_bytes(std::span<std::uint8_t> bytes) const
+{
+    ssize_t bytes_read;
+
+    for(;;)
+    {
+        bytes_read = ::read(fd_, bytes.data(), bytes.size());
+        if(bytes_read >= 0)
+        {
+            return static_cast<std::size_t>(bytes_read);
+        }
+        if(errno == EAGAIN)
+        {
+            return 0U;
+        }
+        if(errno != EINTR)
+        {
+            throw_errno("read");
+        }
+    }
+}
+
+std::size_t Device::read_batch(std::span<Sample> samples) const
+{
+    ssize_t bytes_read;
+
+    if(samples.empty())
+    {
+        return 0U;
+    }
+    for(;;)
+    {
+        bytes_read = ::read(fd_, samples.data(), samples.size_bytes());
+        if(bytes_read >= 0)
+        {
+            /* The driver only returns whole records */
+            return static_cast<std::size_t>(bytes_read) / sizeof(Sample);
+        }
+        if(errno == EAGAIN)
+        {
+            return 0U;
+        }
+        if(errno != EINTR)
+        {
+            throw_errno("read");
+        }
+    }
+}
+
+bool Device::wait(std::chrono::milliseconds timeout) const
+{
+    struct pollfd watched;
+    int ready;
+
+    watched.fd = fd_;
+    watched.events = POLLIN;
+    watched.revents = 0;
+    ready = ::poll(&watched, 1, static_cast<int>(timeout.count()));
+    if(ready < 0)
+    {
+        if(errno == EINTR)
+        {
+            return false;
+        }
+        throw_errno("poll");
+    }
+    return (ready > 0) && ((watched.revents & POLLIN) != 0);
+}
+
+std::optional<Event> Device::next_event() const
+{
+    Event event;
+
+    while(::ioctl(fd_, SIMTEMP_IOC_GET_EVENT, &event) == -1)
+    {
+        if(errno == EAGAIN)
+        {
+            return std::nullopt;
+        }
+        if(errno != EINTR)
+        {
+            throw_errno("SIMTEMP_IOC_GET_EVENT");
+        }
+    }
+    return event;
+}
+
+Stats Device::stats() const
+{
+    Stats stats;
+
+    std::memset(&stats, 0, sizeof(stats));
+    checked_ioctl(fd_, SIMTEMP_IOC_GET_STATS, &stats, "SIMTEMP_IOC_GET_STATS");
+    return stats;
+}
+
+void Device::reset_stats() const
+{
+    checked_ioctl(fd_, SIMTEMP_IOC_RESET_STATS, nullptr, "SIMTEMP_IOC_RESET_STATS");
+}
+
+SampleRange Device::samples(std::span<Sample> buffer) const
+{
+    return SampleRange(*this, buffer);
+}
+
+
+
+/****************************/
+/**** DeltaDecoder **********/
+/****************************/
+/* @brief Decodes whole records, the state is only updated once a record is complete, see SIMTEMP_FORMAT_DELTA */
+DeltaDecoder::Result DeltaDecoder::decode(std::span<const std::uint8_t> bytes, std::span<Sample> samples)
+{
+    Result result{0U, 0U};
+    Sample sample;
+    std::size_t position;
+    std::uint64_t value;
+    std::uint64_t timestamp_delta;
+    std::int64_t temp_delta;
+    std::uint8_t header;
+    std::uint8_t extension;
+
+    while((result.bytes < bytes.size()) && (result.samples < samples.size()))
+    {
+        position = result.bytes;
+        header = bytes[position++];
+        if(header == SIMTEMP_DELTA_KEYFRAME)
+        {
+            if(!get_varint(bytes, &position, &value))
+            {
+                break;
+            }
+            sample.sequence = value;
+            if(!get_varint(bytes, &position, &value))
+            {
+                break;
+            }
+            sample.timestamp_ns = value;
+            if(!get_varint(bytes, &position, &value))
+            {
+                break;
+            }
+            sample.temp_mC = static_cast<__s32>(unzigzag(value));
+            if(!get_varint(bytes, &position, &value))
+            {
+                break;
+            }
+            sample.flags = static_cast<__u32>(value);
+            timestamp_delta = 0U;
+            temp_delta = 0;
+        }
+        else
+        {
+            if(!has_reference_)
+            {
+                throw std::system_error(EILSEQ, std::generic_category(), "delta record before the first keyframe");
+            }
+            sample = previous_;
+            sample.sequence = previous_.sequence + 1U;
+            timestamp_delta = timestamp_delta_;
+            extension = 0U;
+            if(header & SIMTEMP_DELTA_EXTENDED)
+            {
+                if(position >= bytes.size())
+                {
+                    break;
+                }
+                extension = bytes[position++];
+            }
+            if(extension & SIMTEMP_DELTA_EXT_FLAGS)
+            {
+                if(!get_varint(bytes, &position, &value))
+                {
+                    break;
+                }
+                sample.flags = static_cast<__u32>(value);
+            }
+            if(extension & SIMTEMP_DELTA_EXT_LOST)
+            {
+                if(!get_varint(bytes, &position, &value))
+                {
+                    break;
+                }
+                sample.sequence += value;
+            }
+            if(extension & SIMTEMP_DELTA_EXT_TIMESTAMP)
+            {
+                if(!get_varint(bytes, &position, &value))
+                {
+                    break;
+                }
+                timestamp_delta += static_cast<std::uint64_t>(unzigzag(value));
+            }
+            value = header & SIMTEMP_DELTA_TEMP_MASK;
+            if((value == SIMTEMP_DELTA_TEMP_ESCAPE) && !get_varint(bytes, &position, &value))
+            {
+                break;
+            }
+            temp_delta = temp_delta_ + unzigzag(value);
+            sample.timestamp_ns = previous_.timestamp_ns + timestamp_delta;
+            sample.temp_mC = static_cast<__s32>(previous_.temp_mC + temp_delta);
+        }
+
+        /* The record is complete */
+        samples[result.samples++] = sample;
+        previous_ = sample;
+        timestamp_delta_ = timestamp_delta;
+        temp_delta_ = temp_delta;
+        has_reference_ = true;
+        result.bytes = position;
+    }
+    return result;
+}
+
+
+
+/****************************/
+/**** SampleRange ***********/
+/****************************/
+SampleRange::iterator SampleRange::begin()
+{
+    if(exhausted())
+    {
+        refill();
+    }
+    return iterator(this);
+}
+
+SampleRange::iterator &SampleRange::iterator::operator++()
+{
+    range_->position_++;
+    if(range_->exhausted())
+    {
+        range_->refill();
+    }
+    return *this;
+}
+
+/* @brief Reads the next batch only if the driver has samples queued, so a blocking Device does not block here */
+void SampleRange::refill()
+{
+    struct pollfd watched;
+    std::size_t index;
+
+    count_ = 0U;
+    position_ = 0U;
+    watched.fd = device_->fd();
+    watched.events = POLLIN;
+    watched.revents = 0;
+    if((::poll(&watched, 1, 0) <= 0) || ((watched.revents & POLLIN) == 0))
+    {
+        return;
+    }
+    count_ = device_->read_batch(buffer_);
+    for(index = 0U; index < count_; index++)
+    {
+        if(started_ && (buffer_[index].sequence > next_sequence_))
+        {
+            lost_ += buffer_[index].sequence - next_sequence_;
+        }
+        next_sequence_ = buffer_[index].sequence + 1U;
+        started_ = true;
+    }
+}
+
+} /* namespace simtemp */
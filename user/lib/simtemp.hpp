@@ -0,0 +1,225 @@
+/**
+ * @file simtemp.hpp
+ * @brief libsimtemp, C++ client of /dev/simtemp_devN.
+ *        A Device keeps its file descriptor open for its whole life and has no other mutable state, so one Device
+ *        can be shared by several threads: every call is a single system call on that descriptor and the driver
+ *        serializes them. Reading samples never allocates, the caller owns the buffers.
+ *        Errors are reported with std::system_error carrying the errno of the failed call.
+ * @author Enrique Alejandro Padilla Sanchez
+ * @date 23/Oct/2025
+ */
+#ifndef SIMTEMP_HPP
+#define SIMTEMP_HPP
+
+/******************/
+/**** Includes ****/
+/******************/
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include "../../kernel/nxp_simtemp.h"
+
+
+
+namespace simtemp {
+
+/*****************************/
+/**** Type definitions *******/
+/*****************************/
+/* The records exchanged with the driver are used as they are, see nxp_simtemp.h */
+using Sample = ::simtemp_sample;
+using Event = ::simtemp_event;
+using Summary = ::simtemp_summary;
+using Stats = ::simtemp_stats;
+using Waveform = ::simtemp_waveform;
+using FilterChain = ::simtemp_filter_chain;
+
+enum class Mode : std::uint32_t {
+    Normal = SIMTEMP_MODE_NORMAL,
+    Noisy = SIMTEMP_MODE_NOISY,
+    Ramp = SIMTEMP_MODE_RAMP,
+    Sine = SIMTEMP_MODE_SINE,
+    Square = SIMTEMP_MODE_SQUARE,
+    Replay = SIMTEMP_MODE_REPLAY,
+};
+
+enum class Format : std::uint32_t {
+    Samples = SIMTEMP_FORMAT_SAMPLES,
+    Summaries = SIMTEMP_FORMAT_SUMMARIES,
+    Delta = SIMTEMP_FORMAT_DELTA,
+};
+
+enum class Clock : std::uint32_t {
+    Monotonic = SIMTEMP_CLOCK_MONOTONIC,
+    Realtime = SIMTEMP_CLOCK_REALTIME,
+    Boottime = SIMTEMP_CLOCK_BOOTTIME,
+};
+
+/* @brief Device configuration. Device::apply() sends the fields that hold a value in one SIMTEMP_IOC_SET_CONFIG,
+ *        which the driver validates and applies at once. Device::config() returns every field set.
+ */
+struct Config {
+    std::optional<std::chrono::nanoseconds> sampling_period;
+    std::optional<std::int32_t> threshold_mC;
+    std::optional<std::uint32_t> hysteresis_mC;
+    std::optional<Mode> mode;
+    std::optional<Clock> clock;
+    std::optional<std::uint32_t> window_samples; /* Either window limit can be given alone, the other one is kept */
+    std::optional<std::chrono::nanoseconds> window;
+};
+
+/* @brief Latest sample and configuration in effect, taken at once by the driver */
+struct Snapshot {
+    Sample sample;
+    std::uint32_t flags;
+    Config config;
+};
+
+
+
+/*****************************/
+/**** Class definitions ******/
+/*****************************/
+class SampleRange;
+
+/* @brief Open /dev/simtemp_devN. Movable, not copyable, the descriptor is closed by the destructor. */
+class Device {
+public:
+    enum class Blocking { Yes, No };
+
+    explicit Device(const std::string &path, Blocking blocking = Blocking::Yes);
+    explicit Device(unsigned int index, Blocking blocking = Blocking::Yes);
+    Device(Device &&other) noexcept;
+    Device &operator=(Device &&other) noexcept;
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+    ~Device();
+
+    int fd() const noexcept { return fd_; }
+
+    /* Configuration */
+    void apply(const Config &config) const;
+    Config config() const;
+    Snapshot snapshot() const;
+    void set_waveform(const Waveform &waveform) const;
+    Waveform waveform() const;
+    void set_chain(const FilterChain &chain) const;
+    FilterChain chain() const;
+
+    /* @brief Selects what read() returns for this file, the records queued in the previous format are discarded */
+    void set_format(Format format) const;
+    Format format() const;
+
+    /* @brief Reads the samples queued for this file, up to samples.size() in one read(). Returns the number of
+     *        samples stored, 0 if the descriptor is non-blocking and nothing is queued. No allocation.
+     */
+    std::size_t read_batch(std::span<Sample> samples) const;
+
+    /* @brief Same as read_batch() for Format::Delta: reads whole encoded records into bytes, which must hold at
+     *        least SIMTEMP_DELTA_RECORD_MAX bytes, and returns the number of bytes stored. See DeltaDecoder.
+     */
+    std::size_t read_bytes(std::span<std::uint8_t> bytes) const;
+
+    /* @brief Waits up to timeout for samples (POLLIN), returns false on timeout */
+    bool wait(std::chrono::milliseconds timeout) const;
+
+    /* @brief Dequeues the oldest threshold event of this file, std::nullopt when there is none */
+    std::optional<Event> next_event() const;
+
+    Stats stats() const;
+    void reset_stats() const;
+
+    /* @brief Range over the samples available now, read in batches into buffer, see SampleRange */
+    SampleRange samples(std::span<Sample> buffer) const;
+
+private:
+    int fd_;
+};
+
+/* @brief Decoder of the Format::Delta stream described in nxp_simtemp.h (SIMTEMP_FORMAT_DELTA). It keeps the
+ *        previous sample between calls, so the bytes of consecutive reads are fed in order to the same decoder:
+ *
+ *            Device device(0);
+ *            DeltaDecoder decoder;
+ *            device.set_format(Format::Delta);
+ *            std::size_t length = device.read_bytes(bytes);
+ *            DeltaDecoder::Result result = decoder.decode(std::span(bytes).first(length), samples);
+ *
+ *        decode() stops when samples is full or at an incomplete record at the end of bytes, and reports how much
+ *        of both it used: the unused bytes are passed again, with the ones that follow, on the next call.
+ *        A delta record before the first keyframe throws std::system_error with EILSEQ, reset() forgets the
+ *        reference when a stream is restarted. No allocation.
+ */
+class DeltaDecoder {
+public:
+    struct Result {
+        std::size_t bytes;   /* Bytes consumed */
+        std::size_t samples; /* Samples decoded */
+    };
+
+    Result decode(std::span<const std::uint8_t> bytes, std::span<Sample> samples);
+    void reset() noexcept { has_reference_ = false; }
+
+private:
+    bool has_reference_ = false;
+    Sample previous_{};
+    std::uint64_t timestamp_delta_ = 0U;
+    std::int64_t temp_delta_ = 0;
+};
+
+/* @brief Single pass range over the samples that are available when it is iterated. It refills buffer with
+ *        non-blocking reads and ends as soon as the driver has nothing queued, so a consumer typically waits with
+ *        Device::wait() and then walks device.samples(buffer). It keeps the sequence number expected next and
+ *        counts the samples lost in between across iterations, so one range is meant to be used by one thread.
+ */
+class SampleRange {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Sample;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Sample *;
+        using reference = const Sample &;
+
+        iterator() noexcept = default;
+        reference operator*() const noexcept { return range_->buffer_[range_->position_]; }
+        pointer operator->() const noexcept { return &range_->buffer_[range_->position_]; }
+        iterator &operator++();
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const noexcept { return (range_ == nullptr) || range_->exhausted(); }
+
+    private:
+        friend class SampleRange;
+        explicit iterator(SampleRange *range) noexcept : range_(range) {}
+        SampleRange *range_ = nullptr;
+    };
+
+    SampleRange(const Device &device, std::span<Sample> buffer) noexcept : device_(&device), buffer_(buffer) {}
+
+    iterator begin();
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+    /* @brief Samples lost so far, from the gaps in the sequence numbers */
+    std::uint64_t lost() const noexcept { return lost_; }
+
+private:
+    bool exhausted() const noexcept { return position_ >= count_; }
+    void refill();
+
+    const Device *device_;
+    std::span<Sample> buffer_;
+    std::size_t count_ = 0U;
+    std::size_t position_ = 0U;
+    std::uint64_t next_sequence_ = 0U;
+    bool started_ = false;
+    std::uint64_t lost_ = 0U;
+};
+
+} /* namespace simtemp */
+
+#endif /* SIMTEMP_HPP */